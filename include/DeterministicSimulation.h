@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Modalita' deterministica: Physarum ridotto in aritmetica intera, bit-identico tra esecuzioni, numero di
+// thread e backend (GL su qualunque driver, llvmpipe compreso, e il riferimento CPU di questo file).
+//
+//   - posizioni 16.16 su toro, direzione = indice in una tabella cos/sin Q15 calcolata una volta sulla
+//     CPU e caricata identica sulla GPU (niente trigonometria float negli shader)
+//   - trail e depositi uint: i depositi concorrenti sono atomicAdd interi, commutativi, quindi l'ordine
+//     di esecuzione non conta; i sensori leggono solo la trail del passo precedente
+//   - diffusione 3x3 su toro e decadimento in virgola fissa, una cella per invocazione
+//   - casualita' contatore: random(seed, passo, indice), nessuno stato da far avanzare
+//   - hash FNV-1a 64 dello stato (agenti poi trail) calcolato sempre sulla CPU, in ordine di indice
+//
+// Boids, collisioni, mouse, zone, reazione e bordi non toroidali restano fuori: usano float e letture
+// dei vicini il cui risultato dipende dall'ordine di scheduling.
+namespace Deterministic
+{
+    constexpr int      kSpeciesCount   = 3;
+    constexpr int      kDirectionBits  = 12;
+    constexpr uint32_t kDirectionSteps = 1u << kDirectionBits;
+    constexpr uint32_t kDirectionMask  = kDirectionSteps - 1u;
+    constexpr uint32_t kTrailOne = 4096u;    // 1.0 della trail float (Q12)
+    constexpr uint32_t kTrailMax = 65535u;   // saturazione di una cella (16.0)
+    constexpr int32_t  kMaxSpeed = 16 * 256; // px per passo in Q8: il prodotto con la tabella Q15 sta in 31 bit
+    constexpr int32_t  kMaxSensorDistance = 255 * 16;  // px in Q4
+    constexpr int      kMaxSize = 32767;     // lato massimo: x << 16 deve stare in un int32
+    // Flusso casuale dell'inizializzazione; i passi usano il proprio indice (< 2^31)
+    constexpr uint32_t kSeedStream = 0x80000000u;
+
+    // Stato di un agente (uvec4 std430 negli shader)
+    struct Agent {
+        int32_t  x;        // 16.16, [0, width << 16)
+        int32_t  y;        // 16.16, [0, height << 16)
+        uint32_t heading;  // indice nella tabella delle direzioni
+        uint32_t species;  // 0 .. kSpeciesCount-1, sceglie la distanza dei sensori
+    };
+    static_assert(sizeof(Agent) == 16, "Agent deve restare un uvec4");
+
+    // Parametri quantizzati di un passo: la stessa struct alimenta gli uniform GPU e il riferimento CPU
+    struct Params {
+        int32_t  width = 0;            // spazio degli agenti (px)
+        int32_t  height = 0;
+        int32_t  trailDivisor = 1;     // cella della trail = trailDivisor px
+        int32_t  trailWidth = 0;       // ceil(width / trailDivisor)
+        int32_t  trailHeight = 0;
+        int32_t  speed = 0;            // px per passo, Q8
+        int32_t  sensorDistance[kSpeciesCount] = {};  // px, Q4
+        uint32_t sensorAngle = 0;      // passi della tabella
+        uint32_t turnAngle = 0;
+        uint32_t deposit = 0;          // Q12 per agente e passo
+        uint32_t fade = 0;             // Q16, moltiplica la media 3x3
+        uint32_t seed = 0;
+    };
+
+    // Conversioni dai parametri float dell'interfaccia (arrotondamento al piu' vicino, saturate)
+    uint32_t angleToSteps(float radians);
+    int32_t  toFixed(float value, int fractionBits, int32_t minValue, int32_t maxValue);
+
+    // Tabella (cos, sin) Q15 per kDirectionSteps direzioni, interleaved
+    const std::vector<int32_t>& directionTable();
+
+    // Hash PCG (stesso di update.comp) e generatore a contatore
+    uint32_t hash(uint32_t value);
+    uint32_t random(uint32_t seed, uint32_t stream, uint32_t index);
+
+    // Stato iniziale di count agenti, distribuiti uniformemente (funzione solo di seed e dimensioni)
+    void seedAgents(const Params& params, int count, std::vector<Agent>& out);
+
+    constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+    uint64_t fnv1a(const void* data, size_t bytes, uint64_t hash = kFnvOffset);
+    uint64_t stateHash(const Agent* agents, size_t agentCount, const uint32_t* trail, size_t cellCount);
+
+    // Costanti iniettate dopo #version negli shader det_*.comp
+    std::string glslDefinitions();
+
+    // Riferimento CPU: stessi passi e stessa aritmetica degli shader det_update / det_trail
+    class Simulation
+    {
+    public:
+        void reset(const Params& params, int agentCount);
+        // threads = 0: hardware_concurrency. Il risultato non dipende dal numero di thread.
+        void step(const Params& params, int threads = 0);
+
+        uint64_t stateHash() const;
+        uint32_t getStep() const { return m_step; }
+        const std::vector<Agent>& agents() const { return m_agents; }
+        const std::vector<uint32_t>& trail() const { return m_trail; }
+
+    private:
+        std::vector<Agent>    m_agents;
+        std::vector<uint32_t> m_trail;
+        std::vector<uint32_t> m_nextTrail;
+        std::vector<uint32_t> m_deposit;
+        std::vector<uint32_t> m_depositCell;   // cella di deposito per agente, sommata in un secondo giro
+        int      m_trailWidth = 0;
+        int      m_trailHeight = 0;
+        uint32_t m_step = 0;
+    };
+}
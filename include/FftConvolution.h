@@ -0,0 +1,40 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+// Convoluzione FFT su toro per kernel grandi (diffusione a raggio ampio, kernel tipo Lenia).
+// Il campo W x H viene copiato in un buffer M (potenza di 2, M >= N + 2R) con un bordo avvolto di R texel:
+// la convoluzione lineare in M, letta nella finestra centrale, coincide con quella circolare sul toro N.
+namespace Fft
+{
+    using Complex = std::complex<float>;
+
+    enum class KernelType
+    {
+        Gaussian = 0,   // diffusione isotropa, sigma = radius / 3
+        Lenia,          // anello liscio exp(4 - 1/(r(1-r))), r = distanza / radius
+        Count
+    };
+
+    // Lato massimo supportato dalla FFT GPU (una linea intera in shared memory, vec2 x 4096 = 32 KB)
+    constexpr int kMaxGpuLength = 4096;
+
+    int nextPowerOfTwo(int n);
+
+    // Dimensioni del buffer di lavoro per un campo width x height e un kernel di raggio radius
+    void paddedSize(int width, int height, int radius, int& paddedWidth, int& paddedHeight);
+
+    // FFT 2D radix-2 in place (righe poi colonne, lati potenze di 2) su threads thread (0 = hardware_concurrency).
+    // Inversa non normalizzata.
+    void transform2D(std::vector<Complex>& data, int width, int height, bool inverse, int threads = 0);
+
+    // Spettro del kernel nel buffer paddedWidth x paddedHeight. Il kernel e' normalizzato a somma 1
+    // e lo spettro include il fattore 1/(paddedWidth * paddedHeight) dell'inversa.
+    std::vector<Complex> kernelSpectrum(KernelType type, int radius, int paddedWidth, int paddedHeight);
+
+    // Convoluzione su toro, in place, dei primi channels canali di un campo RGBA float (4 float per texel).
+    // Due canali reali viaggiano insieme come parte reale e immaginaria dello stesso buffer complesso.
+    void convolveTorus(std::vector<float>& rgba, int width, int height, int channels, int radius,
+                       const std::vector<Complex>& spectrum, int paddedWidth, int paddedHeight, int threads = 0);
+}
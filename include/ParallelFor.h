@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace Parallel
+{
+    // Esegue fn(begin, end) su intervalli contigui di [0, count) distribuiti tra i thread
+    // (0 = hardware_concurrency). Il thread chiamante esegue il primo intervallo.
+    template <typename Fn>
+    void forRange(int count, int threads, Fn fn)
+    {
+        if (count <= 0) return;
+        if (threads <= 0) threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        threads = std::max(1, std::min(threads, count));
+        if (threads == 1) {
+            fn(0, count);
+            return;
+        }
+
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+        int chunk = (count + threads - 1) / threads;
+        for (int t = 1; t < threads; ++t) {
+            int begin = t * chunk;
+            int end = std::min(count, begin + chunk);
+            if (begin >= end) break;
+            workers.emplace_back(fn, begin, end);
+        }
+        fn(0, std::min(count, chunk));
+        for (auto& worker : workers) worker.join();
+    }
+}
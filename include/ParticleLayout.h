@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Record delle particelle in GPU. Una sola definizione per layout (X-macro) genera sia le struct C++
+// sia le struct GLSL iniettate negli shader dopo #version: i due lati non possono divergere.
+//
+//   Standard (32 byte): float, specie intera, flag e stato PCG per particella nell'ultima parola
+//   Packed   (16 byte): posizione float, direzione snorm16 x2, velocita' half + specie e flag a 8 bit.
+//                       Niente spazio per lo stato PCG: e' derivato da indice e passo (uParticleRngStep)
+//   Split    (32 byte): structure-of-arrays, tre stream separati (posizioni 8 B, moto 16 B, attributi 8 B)
+//
+// La direzione e' un versore (niente angolo): il passo di update non ricava piu' cos/sin ad ogni lettura.
+//
+// Gli shader non vedono i record: il prelude generato dichiara gli SSBO (ingresso readonly, uscita
+// writeonly) e le funzioni di accesso loadParticle / loadParticlePosition / loadParticleDirection /
+// loadParticleSpeed / loadParticleSpecies / storeParticle, che lavorano sulla struct logica Particle.
+// Con Split ogni pass legge solo gli stream che usa (la griglia 8 byte per particella invece di 32).
+//
+// X(tipo C++, suffisso array C++, tipo GLSL, nome)
+#define PARTICLE_STANDARD_FIELDS(X)         \
+    X(float,    [2], vec2,  position)       \
+    X(float,    [2], vec2,  direction)      \
+    X(float,    ,    float, speed)          \
+    X(uint32_t, ,    uint,  species)        \
+    X(uint32_t, ,    uint,  flags)          \
+    X(uint32_t, ,    uint,  rngState)
+
+#define PARTICLE_PACKED_FIELDS(X)           \
+    X(float,    [2], vec2,  position)       \
+    X(uint32_t, ,    uint,  direction)      \
+    X(uint32_t, ,    uint,  speedSpeciesFlags)
+
+// Stream del layout Split, nell'ordine dei binding
+#define PARTICLE_SPLIT_POSITION_FIELDS(X)   \
+    X(float,    [2], vec2,  position)
+
+#define PARTICLE_SPLIT_MOTION_FIELDS(X)     \
+    X(float,    [2], vec2,  direction)      \
+    X(float,    ,    float, speed)          \
+    X(uint32_t, ,    uint,  rngState)
+
+#define PARTICLE_SPLIT_ATTRIBUTE_FIELDS(X)  \
+    X(uint32_t, ,    uint,  species)        \
+    X(uint32_t, ,    uint,  flags)
+
+#define PARTICLE_CPP_FIELD(cppType, cppArray, glslType, name) cppType name cppArray;
+#define PARTICLE_GLSL_FIELD(cppType, cppArray, glslType, name) "    " #glslType " " #name ";\n"
+
+// Layout standard: e' anche la rappresentazione CPU usata per inizializzare e leggere le particelle
+struct GpuParticle {
+    PARTICLE_STANDARD_FIELDS(PARTICLE_CPP_FIELD)
+};
+
+struct GpuParticlePacked {
+    PARTICLE_PACKED_FIELDS(PARTICLE_CPP_FIELD)
+};
+
+struct GpuParticlePosition {
+    PARTICLE_SPLIT_POSITION_FIELDS(PARTICLE_CPP_FIELD)
+};
+
+struct GpuParticleMotion {
+    PARTICLE_SPLIT_MOTION_FIELDS(PARTICLE_CPP_FIELD)
+};
+
+struct GpuParticleAttributes {
+    PARTICLE_SPLIT_ATTRIBUTE_FIELDS(PARTICLE_CPP_FIELD)
+};
+
+static_assert(sizeof(GpuParticle) == 32, "GpuParticle deve restare 32 byte (std430, stride 2x vec4)");
+static_assert(sizeof(GpuParticlePacked) == 16, "GpuParticlePacked deve restare 16 byte");
+static_assert(sizeof(GpuParticlePosition) == 8 && sizeof(GpuParticleMotion) == 16 && sizeof(GpuParticleAttributes) == 8,
+              "Gli stream Split devono avere lo stride std430 delle struct GLSL");
+
+// Conteggio delle particelle tenuto in GPU (emettitori): argomenti di glDispatchComputeIndirect per i
+// pass da 256 e da 128 invocazioni, particelle vive e sopravvissute all'ultima compattazione.
+// Il buffer contiene due record: quello corrente e quello in preparazione durante la compattazione.
+struct GpuParticleCount {
+    uint32_t dispatch256[3];
+    uint32_t dispatch128[3];
+    uint32_t liveCount;
+    uint32_t survivors;
+};
+
+static_assert(sizeof(GpuParticleCount) == 32, "GpuParticleCount deve avere lo stride std430 di ParticleCountRecord");
+
+// L'ordine e' salvato nei preset (particleLayout N): aggiungere solo in coda
+enum class ParticleLayout { Standard = 0, Packed, Split, Count };
+
+namespace Particles
+{
+    constexpr int kMaxStreams = 3;
+    // Binding (readonly) del record corrente di GpuParticleCount, letto da particleCount() negli shader
+    constexpr int kCountBinding = 21;
+    // Location esplicite degli uniform del prelude, uguali in tutti i programmi: si impostano senza
+    // glGetUniformLocation. uParticleRngStep esiste solo nel layout Packed.
+    constexpr int kCountLocation = 0;
+    constexpr int kRngStepLocation = 1;
+    // Le particelle restano raggruppate per specie: la semina assegna la specie a blocchi di kSpeciesBlock
+    // indici (multiplo dei workgroup da 128 e 256), la compattazione degli emettitori ordina per specie.
+    // Ogni workgroup legge cosi' una sola riga della tabella delle specie, senza divergenza.
+    constexpr int kSpeciesBlock = 256;
+
+    // Uno stream = un array std430 in una regione del buffer delle particelle, con i suoi binding
+    // per il buffer di ingresso (readonly) e di uscita (writeonly). Lo stream 0 usa sempre 0 / 1.
+    struct Stream {
+        size_t stride;
+        int    inBinding;
+        int    outBinding;
+    };
+
+    int streamCount(ParticleLayout layout);
+    Stream stream(ParticleLayout layout, int index);
+
+    // SSBO dichiarati dal prelude: ingresso e uscita di ogni stream piu' il record del conteggio
+    int storageBlocks(ParticleLayout layout);
+
+    // Byte per particella, somma di tutti gli stream
+    size_t stride(ParticleLayout layout);
+    const char* label(ParticleLayout layout);
+
+    // Codice GLSL: struct dei record (dalla X-macro), struct Particle, SSBO e funzioni di accesso,
+    // uniform uParticleCount e particleCount() (uParticleCount < 0: conteggio in GPU), PARTICLE_SPECIES_BLOCK
+    std::string glslDefinitions(ParticleLayout layout);
+
+    // Conversione tra la rappresentazione CPU e i byte di uno stream del layout scelto.
+    // decode ridimensiona out a count mantenendo i campi degli altri stream gia' decodificati.
+    void encode(const GpuParticle* particles, size_t count, ParticleLayout layout, int streamIndex, std::vector<unsigned char>& out);
+    void decode(const void* data, size_t count, ParticleLayout layout, int streamIndex, std::vector<GpuParticle>& out);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+// Pass GPU di un passo di simulazione con barriere derivate dagli accessi dichiarati.
+// Prima di ogni dispatch il pass dichiara buffer e texture che legge e scrive (access()): per le risorse
+// scritte da uno shader e non ancora rese visibili per quel tipo di accesso il grafo emette un solo
+// glMemoryBarrier con i bit mancanti, niente per le altre. Le dipendenze si tracciano per oggetto GL
+// (e livello di mip per le texture): scritture in intervalli disgiunti dello stesso buffer restano ordinate.
+// I pass girano nell'ordine in cui vengono eseguiti (run()), quelli disattivati non emettono niente; ognuno
+// ha una coppia di timestamp GPU, in due set alternati letti due passi dopo (niente stalli sulla CPU).
+class PassGraph
+{
+public:
+    enum class Access : uint8_t {
+        StorageRead,    // SSBO in sola lettura
+        StorageWrite,   // SSBO scritto (anche atomici e read-modify-write)
+        ImageRead,      // imageLoad
+        ImageWrite,     // imageStore (anche imageLoad + imageStore sullo stesso texel)
+        Sampled,        // texture() / texelFetch via sampler
+        Indirect,       // argomenti di glDispatchComputeIndirect
+        Transfer,       // comandi GL: glGetBufferSubData, glCopyBufferSubData, glGetTexImage, glTexSubImage2D...
+    };
+
+    struct Use {
+        GLuint object;
+        int    level;     // livello di mip, -1 = tutti (i buffer usano sempre -1)
+        bool   texture;
+        Access access;
+    };
+    static Use buffer(GLuint object, Access access) { return { object, -1, false, access }; }
+    static Use texture(GLuint object, Access access, int level = -1) { return { object, level, true, access }; }
+
+    PassGraph();
+    ~PassGraph();
+
+    // Query dei timer per passCount pass (indici stabili scelti dal chiamante)
+    void initialize(int passCount);
+    void release();
+
+    // Inizio passo: legge i timer del set che sta per essere riscritto. true se sono arrivati nuovi tempi
+    // (collectedSet() dice a quale passo appartengono).
+    bool beginFrame();
+    // Fine passo: flush() e cambio di set dei timer
+    void endFrame();
+
+    // Esegue body tra i timestamp del pass; disattivato = nessun timer, nessuna barriera
+    template <typename Body>
+    void run(int pass, const char* name, bool enabled, Body&& body)
+    {
+        if (!enabled) return;
+        beginPass(pass, name);
+        body();
+        endPass(pass);
+    }
+
+    // Accessi del prossimo dispatch (o comando GL): barriera minima per le scritture precedenti, poi le
+    // scritture dichiarate diventano pendenti. Valido anche fuori da un passo (benchmark, resize).
+    void access(std::initializer_list<Use> uses);
+
+    // Rende visibili a qualsiasi uso tutte le scritture pendenti: chi sta fuori dal grafo (rendering,
+    // resize, readback dei buffer) non dichiara i propri accessi
+    void flush();
+
+    // I timestamp in volo appartengono alla configurazione precedente
+    void discardTimings();
+
+    int         passCount() const { return static_cast<int>(m_passes.size()); }
+    const char* passName(int pass) const { return m_passes[pass].name; }
+    bool        passRan(int pass) const { return m_passes[pass].ran; }   // nel passo di collectedSet()
+    float       passMs(int pass) const { return m_passes[pass].ms; }
+    int         collectedSet() const { return m_collectedSet; }
+    int         frameSet() const { return m_set; }
+    int         getLastBarrierCount() const { return m_lastBarrierCount; }   // glMemoryBarrier nell'ultimo passo
+
+private:
+    struct PassSlot {
+        const char* name = "";
+        GLuint      queries[2][2] = {};
+        bool        issued[2] = { false, false };
+        bool        ran = false;
+        float       ms = 0.0f;
+    };
+    // Risorsa scritta da uno shader: bit di barriera gia' emessi dopo l'ultima scrittura
+    struct PendingWrite {
+        GLuint     object;
+        int        level;
+        bool       texture;
+        GLbitfield visible;
+    };
+
+    void beginPass(int pass, const char* name);
+    void endPass(int pass);
+    void barrier(GLbitfield bits);
+
+    std::vector<PassSlot>     m_passes;
+    std::vector<PendingWrite> m_pending;
+    int    m_set;
+    int    m_collectedSet;
+    bool   m_setPending[2];
+    GLuint m_lastQuery[2];        // ultimo timestamp registrato nel set: disponibile = set completo
+    int    m_barrierCount;
+    int    m_lastBarrierCount;
+};
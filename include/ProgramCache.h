@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+
+// Programmi GLSL con cache su disco dei binari (glGetProgramBinary). Un file per programma, nominato con
+// l'hash di vendor, renderer, versione del driver e sorgenti finali (defines inclusi): un driver nuovo o uno
+// shader modificato cambiano nome, i binari vecchi restano inutilizzati e quelli scartati vengono rimossi.
+// La compilazione e' divisa in avvio e verifica: avviando piu' programmi prima di verificarli, con
+// GL_KHR/ARB_parallel_shader_compile il driver li compila sui suoi thread invece di serializzarli.
+namespace ProgramCache
+{
+    struct Stats {
+        int    loaded = 0;      // programmi caricati dai binari in cache
+        int    compiled = 0;    // programmi compilati dai sorgenti
+        int    rejected = 0;    // binari scartati dal driver (ricompilati)
+        double ms = 0.0;        // tempo CPU speso tra avvio e verifica dei programmi
+    };
+
+    // Programma avviato: gia' pronto se caricato dalla cache, altrimenti in compilazione
+    struct Pending {
+        GLuint      program = 0;
+        std::string key;
+        std::string label;
+        bool        cached = false;
+    };
+
+    // Directory della cache (creata se manca); vuota = cache disattivata. Da chiamare con un contesto
+    // corrente: senza formati binari del driver la cache resta spenta.
+    void setDirectory(const std::string& directory);
+    bool isEnabled();
+    bool hasParallelCompile();
+
+    // Sorgenti completi (defines gia' iniettati)
+    Pending startCompute(const std::string& source, const std::string& label);
+    Pending startGraphics(const std::string& vertexSource, const std::string& fragmentSource, const std::string& label);
+
+    // true quando finish() non blocca: sempre per i binari in cache, via GL_COMPLETION_STATUS con
+    // parallel_shader_compile, mai senza (il chiamante decide quando attendere)
+    bool isComplete(const Pending& pending);
+
+    // Verifica compilazione e link, salva i binari dei programmi compilati e restituisce il programma.
+    // @throw std::runtime_error "<label> shader compile error (<TIPO>)" o "<label> shader link error" con il log
+    GLuint finish(Pending& pending);
+
+    const Stats& stats();
+    void resetStats();
+}
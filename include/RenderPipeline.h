@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <cstdint>
 #include "SimulationGPU.h"
 #include "Shader.h"
 
@@ -26,6 +27,16 @@ public:
         m_backgroundColor[1] = color[1];
         m_backgroundColor[2] = color[2];
     }
+    // Tone mapping log + auto-dim: applicati in visualizzazione tramite LUT 1D (lo stato della simulazione resta lineare)
+    void setToneMapping(float exposure, float dimThreshold, float dimStrength, float dimGlobal) {
+        m_toneExposure = exposure;
+        m_autoDimThreshold = dimThreshold;
+        m_autoDimStrength = dimStrength;
+        m_autoDimGlobal = dimGlobal;
+    }
+
+    // Sovrapposizione del campo di reazione (V) sull'immagine finale, 0 = spenta
+    void setReactionOverlay(float strength) { m_reactionOverlay = strength; }
 
 private:
     int m_width, m_height;
@@ -37,9 +48,25 @@ private:
     // Shader per il pass finale
     Shader m_finalShader;
 
-    // Uniform location
-    GLint m_particles_uSimSizeLoc;
-    GLint m_final_uTextureLoc;
+    // Parametri del pass finale: uniform block std140 (binding kRenderParamsBinding, agganciato in initialize)
+    // ricaricato solo se diverso dall'ultima copia. Le texture hanno unita' fisse nello shader.
+    static constexpr int kRenderParamsBinding = 3;
+    struct RenderParams {
+        float   color1[3];
+        float   time;
+        float   color2[3];
+        float   neonSpeed;
+        float   backgroundColor[3];
+        float   neonRange;
+        float   toneLutScaleBias[2];
+        int32_t colorMode;
+        int32_t trailChannels;
+        float   reactionOverlay;
+        float   padding[3];
+    };
+    RenderParams m_renderParams = {};
+    bool   m_renderParamsValid = false;
+    GLuint m_renderParamsUBO = 0;
     
     // Post-Process Params
     int m_colorMode = 0;
@@ -50,8 +77,25 @@ private:
     float m_neonRange = 1.0f;
     float m_backgroundColor[3] = {0.0f, 0.0f, 0.0f};
 
+    // Tone mapping
+    float m_toneExposure = 3.0f;
+    float m_autoDimThreshold = 0.25f;
+    float m_autoDimStrength = 0.5f;
+    float m_autoDimGlobal = 4.0f;
+
+    float m_reactionOverlay = 0.0f;
+
+    // LUT 1D (RG32F): R = curva log sul valore lineare, G = fattore di auto-dim sulla luminanza tonemappata.
+    // Viene ricalcolata solo quando cambiano i parametri o il range del formato.
+    static constexpr int kToneLutSize = 1024;
+    GLuint m_toneLutTexture = 0;
+    float  m_toneLutKey[5] = {-1.0f, -1.0f, -1.0f, -1.0f, -1.0f}; // exposure, threshold, strength, global, range
+    float  m_toneLutRange = 1.0f;
+
 private:
     void finalPass(const SimulationGPU& simulation);
+    void updateToneLut(float range);
+    void uploadRenderParams(const RenderParams& params);
     void setupQuadVAO();
     void renderQuad();
 };
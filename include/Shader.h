@@ -22,7 +22,7 @@ public:
 
     /**
      * @brief Carica e compila i sorgenti degli shader vertex e fragment,
-     *        quindi linka il program.
+     *        quindi linka il program. Il binario linkato passa dalla cache di ProgramCache.
      *
      * @param vertexPath   Percorso del file sorgente Vertex Shader.
      * @param fragmentPath Percorso del file sorgente Fragment Shader.
@@ -62,18 +62,6 @@ private:
      */
     std::string readFile(const std::string& filePath);
 
-    /**
-     * @brief Compila uno shader sorgente di tipo vertex o fragment.
-     *
-     * @param source     Sorgente dello shader (codice GLSL).
-     * @param shaderType Tipo di shader (GL_VERTEX_SHADER o GL_FRAGMENT_SHADER).
-     *
-     * @return GLuint ID dello shader compilato (intermedio).
-     *
-     * @throw std::runtime_error Se la compilazione fallisce.
-     */
-    GLuint compileShader(const std::string& source, GLenum shaderType);
-
 private:
     GLuint m_programID; ///< ID del programma shader creato con glCreateProgram()
     bool   m_isLoaded;  ///< Flag che indica se lo shader è correttamente caricato
@@ -2,15 +2,18 @@
 
 #include <glad/glad.h>
 #include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "DeterministicSimulation.h"
+#include "FftConvolution.h"
+#include "ParticleLayout.h"
+#include "PassGraph.h"
+#include "ProgramCache.h"
 
-// Struttura GpuParticle
-struct GpuParticle {
-    float position[2];
-    float angle;
-    float speed;
-    float species;     // 0.0, 1.0, etc.
-    float _pad[3];     // Padding to reach 32 bytes (2x vec4 alignment friendly)
-};
+// Numero di specie (species = 0 .. kSpeciesCount-1)
+constexpr int kSpeciesCount = 3;
 
 class SimulationGPU
 {
@@ -22,17 +25,159 @@ public:
     void initialize();
     void update(float dt, float mouseX, float mouseY, bool mousePressed, int mouseMode);
 
-    enum class TextureFormat { R8, RG8, RGBA8 };
+    // Formati della trail map. L'ordine e' salvato nei preset (textureFormat N): aggiungere solo in coda.
+    enum class TextureFormat { R8, RG8, RGBA8, R16F, RG16F, R11G11B10F, RGBA16F, Count };
+
+    // Descrizione statica di un formato (GL enums, define per gli shader, costo in memoria)
+    struct TextureFormatInfo {
+        GLenum      internalFormat;
+        GLenum      pixelFormat;
+        GLenum      pixelType;
+        const char* shaderDefine;
+        const char* label;
+        int         bytesPerTexel;
+        int         channels;
+        bool        isFloat;
+    };
+    static const TextureFormatInfo& getTextureFormatInfo(TextureFormat format);
+
+    // Tempi GPU medi (ms) misurati per formato, a regime (ramp-up concluso)
+    struct FormatTiming {
+        float updateMs = 0.0f;
+        float blurMs   = 0.0f;
+        int   samples  = 0;
+    };
+    const FormatTiming& getFormatTiming(TextureFormat format) const { return m_formatTimings[static_cast<int>(format)]; }
+    void   resetFormatTiming(TextureFormat format) { m_formatTimings[static_cast<int>(format)] = FormatTiming(); }
+    // Tempi medi del pass di update per modalita' di sensing (0 = imageLoad legacy, 1 = sampler)
+    const FormatTiming& getSensingTiming(bool samplerSensing) const { return m_sensingTimings[samplerSensing ? 1 : 0]; }
+    void   resetSensingTiming() { m_sensingTimings[0] = FormatTiming(); m_sensingTimings[1] = FormatTiming(); }
+    // Memoria occupata dalle due trail map (ping-pong) con il formato dato
+    size_t getTrailMemoryBytes(TextureFormat format) const;
+    // Ramp-up in corso: i tempi non entrano nelle medie per formato (con gli emettitori non c'e' ramp-up)
+    bool   isRampingUp() const { return !m_emittersEnabled && m_activeParticles < m_targetParticles; }
+
+    // Ultimi tempi GPU letti dalle timer query (ms)
+    float getLastGridMs() const   { return m_lastGridMs; }
+    float getLastUpdateMs() const { return m_lastUpdateMs; }
+    float getLastBlurMs() const   { return m_lastBlurMs; }
+    float getLastReactionMs() const { return m_lastReactionMs; }
+    float getLastEmitterMs() const  { return m_lastEmitterMs; }   // compattazione e nascite (solo con emettitori)
+    // Tempi GPU per pass (passName / passRan / passMs) e barriere emesse nell'ultimo passo
+    const PassGraph& getPassGraph() const { return m_passGraph; }
+    // Tempo CPU medio di un passo di update() (ms): preparazione e invio dei comandi, accanto ai tempi GPU.
+    // Include i readback sincroni (campionamento delle velocita'), che per qualche passo lo alzano.
+    float getSubmitMs() const { return m_submitMs; }
+
+    // Rilevamento dello stato stazionario: ogni interval step una riduzione GPU confronta le somme per tile
+    // (16x16 texel) della trail con quelle del campionamento precedente e somma l'energia delle particelle.
+    // Readback asincrono (fence, due set alternati): i valori arrivano con un campionamento di ritardo.
+    struct ActivityMetrics {
+        float trailChange  = 1.0f;   // sum |tile - tile precedente| / sum tile
+        float energyChange = 1.0f;   // |E - E precedente| / E, E = sum speed^2
+        int   sample       = 0;      // incrementato a ogni nuovo readback
+    };
+    bool  isActivityTrackingEnabled() const { return m_activityEnabled; }
+    void  setActivityTrackingEnabled(bool enabled) { m_activityEnabled = enabled; }
+    int   getActivityInterval() const { return m_activityInterval; }
+    void  setActivityInterval(int steps) { m_activityInterval = std::clamp(steps, 1, 120); }
+    const ActivityMetrics& getActivityMetrics() const { return m_activity; }
 
     // Accesso al buffer delle particelle (per eventuale debug drawing)
     GLuint getParticleBuffer() const { return m_particleBuffers[m_currentBuffer]; }
+    // Con gli emettitori il numero di particelle vive esiste solo in GPU: qui resta il tetto della popolazione
     int    getParticleCount() const  { return m_activeParticles; }
+    bool   isParticleCountOnGpu() const { return m_emittersEnabled; }
     int    getMaxParticleCount() const { return m_maxParticles; }
+
+    // Capacita' da un budget di memoria: particelle (record standard) che stanno in budgetBytes insieme a
+    // trail (catena mip), campo di reazione e griglia alla risoluzione data. Per particella conta il caso
+    // peggiore, due buffer (boids o collisioni) piu' il link ParticleNext della griglia. Restano fuori i
+    // buffer allocati su richiesta (FFT, modalita' deterministica).
+    static constexpr int kMinParticleCapacity = 100000;
+    static constexpr int kMaxParticleCapacity = 1 << 28;
+    static size_t estimateFieldMemoryBytes(int width, int height, TextureFormat format, int trailDivisor);
+    static int    planParticleCapacity(uint64_t budgetBytes, int width, int height, TextureFormat format, int trailDivisor);
+
+    // Layout dei record in GPU (vedi ParticleLayout.h). Il budget in byte dei buffer resta quello del
+    // costruttore (particleCount record standard): il layout compatto raddoppia le particelle massime.
+    // Cambiarlo ricrea buffer e shader delle particelle e riparte dal ramp-up.
+    // Un layout che supera GL_MAX_COMPUTE_SHADER_STORAGE_BLOCKS (garantiti solo 8; Split ne usa fino a 11)
+    // viene rifiutato: all'avvio si ripiega su Standard, a runtime resta il layout corrente.
+    ParticleLayout getParticleLayout() const { return m_particleLayout; }
+    void   setParticleLayout(ParticleLayout layout);
+    bool   isParticleLayoutSupported(ParticleLayout layout) const;
+    // Memoria GPU delle particelle: il secondo buffer esiste solo con boids, collisioni o emettitori attivi
+    size_t getParticleBufferBytes() const { return (m_particleBuffers[1] ? 2 : 1) * m_particleBufferSize; }
+    bool   isParticleDoubleBuffered() const { return m_particleBuffers[1] != 0; }
     void   setActiveParticleCount(int count);
 
-    // Resizes simulation and changes texture format upon request
-    void   resize(int width, int height, TextureFormat format);
+    // Seme di tutta la casualita' della simulazione: posizioni iniziali e stato PCG di ogni particella,
+    // entrambi generati in GPU (seed.comp). Impostarlo dopo initialize() azzera trail e campo e
+    // riparte dal ramp-up: stesso seme e stessi parametri ripetono la stessa sequenza casuale
+    // (l'ordine dei depositi concorrenti sulla trail resta quello della GPU).
+    uint32_t getRandomSeed() const { return m_randomSeed; }
+    void     setRandomSeed(uint32_t seed);
+
+    // Distribuzione delle particelle aggiunte dal ramp-up (seed.comp, un dispatch per blocco di particelle).
+    // Image campiona per rifiuto la luminanza dell'immagine di setSeedImage o, senza immagine, la trail
+    // corrente. L'ordine e' salvato nei preset (seedDistribution N): aggiungere solo in coda.
+    enum class SeedDistribution { CenterBurst = 0, Uniform, Ring, Image, Count };
+    SeedDistribution getSeedDistribution() const { return m_seedDistribution; }
+    void setSeedDistribution(SeedDistribution distribution) { if (distribution < SeedDistribution::Count) m_seedDistribution = distribution; }
+    // Luminanza 8 bit, width x height righe dall'alto, stirata su tutto il campo; vuota = torna alla trail.
+    // Richiede il contesto GL (dopo initialize()).
+    void setSeedImage(const std::vector<uint8_t>& luminance, int width, int height);
+
+    // Emettitori (fuoco, pennacchi): al posto del ramp-up ogni emettitore crea rate particelle al secondo,
+    // ciascuna con una durata di vita casuale in [lifetimeMin, lifetimeMax]. Ogni passo una compattazione
+    // in GPU (prefix sum sul flag di vita, compact.comp) toglie le morte e accoda le nuove; il numero di
+    // particelle vive resta in GPU e guida i pass per particella con glDispatchComputeIndirect.
+    // Il numero di particelle di setActiveParticleCount diventa il tetto della popolazione.
+    // Abilitarli riparte da zero particelle; servono i due buffer delle particelle.
+    enum class EmitterShape { Point = 0, Line, Region, Count };
+    struct ParticleEmitter {
+        EmitterShape shape = EmitterShape::Point;
+        float x0 = 0.5f, y0 = 0.1f;   // coordinate normalizzate del campo [0, 1], y verso l'alto
+        float x1 = 0.5f, y1 = 0.1f;   // secondo estremo (Line) o angolo opposto (Region)
+        float rate = 20000.0f;        // particelle al secondo
+        float lifetimeMin = 1.0f;     // secondi
+        float lifetimeMax = 3.0f;
+        float angle = 1.5707963f;     // direzione di uscita (rad, pi/2 = verso l'alto)
+        float spread = 0.6f;          // apertura attorno ad angle (rad)
+    };
+    static constexpr int kMaxEmitters = 16;
+    bool isEmittersEnabled() const { return m_emittersEnabled; }
+    void setEmittersEnabled(bool enabled);
+    const std::vector<ParticleEmitter>& getEmitters() const { return m_emitters; }
+    // Oltre kMaxEmitters gli emettitori sono ignorati
+    void setEmitters(const std::vector<ParticleEmitter>& emitters);
+
+    // Modalita' deterministica (DeterministicSimulation.h): al posto del passo normale gira un Physarum
+    // ridotto in aritmetica intera, bit-identico tra esecuzioni e driver. Usa sensori, velocita', deposito,
+    // fade, numero di particelle e seme correnti; boids, mouse, zone e reazione sono ignorati, bordi sempre
+    // toroidali. Ogni hashInterval passi stampa l'hash dello stato; con il riferimento attivo la CPU esegue
+    // gli stessi passi in lockstep e l'hash GPU viene confrontato con il suo.
+    bool     isDeterministicEnabled() const { return m_deterministicEnabled; }
+    void     setDeterministicEnabled(bool enabled);
+    int      getDeterministicHashInterval() const { return m_deterministicHashInterval; }
+    void     setDeterministicHashInterval(int steps) { m_deterministicHashInterval = std::clamp(steps, 1, 100000); }
+    bool     isDeterministicReferenceEnabled() const { return m_deterministicReference; }
+    void     setDeterministicReferenceEnabled(bool enabled);
+    uint32_t getDeterministicStep() const { return m_deterministicStep; }
+    // Ultimo hash calcolato (0 prima del primo intervallo) e stato del confronto con la CPU
+    uint64_t getDeterministicHash() const { return m_deterministicHash; }
+    bool     isDeterministicDiverged() const { return m_deterministicDiverged; }
+
+    // Resizes simulation and changes texture format upon request.
+    // trailDivisor (1, 2, 4) riduce solo la risoluzione della trail map: le particelle restano
+    // nello spazio width x height, depositano e leggono la trail in bilineare, il pass finale scala.
+    // Lo stato viene conservato: posizioni riscalate, trail e campo ricampionati nel nuovo formato.
+    void   resize(int width, int height, TextureFormat format, int trailDivisor = 1);
     TextureFormat getTextureFormat() const { return m_textureFormat; }
+    int    getTrailDivisor() const { return m_trailDivisor; }
+    int    getTrailWidth() const  { return m_trailWidth; }
+    int    getTrailHeight() const { return m_trailHeight; }
 
     // Restituisce la texture finale (dopo l'ultimo pass). 
     GLuint getFinalTexture() const { return m_textureIDIn; }
@@ -44,6 +189,128 @@ public:
     float getSensorAngle() const { return m_sensorAngle; }
     void setSensorAngle(float val) { m_sensorAngle = val; }
     
+    // Sensing dal frame precedente via sampler2D (bilineare, cache texture); false = imageLoad sulla
+    // stessa image in cui si deposita (legacy, i sensori vedono i depositi del passo in corso)
+    bool isSamplerSensingEnabled() const { return m_samplerSensing; }
+    void setSamplerSensingEnabled(bool enabled) { m_samplerSensing = enabled; }
+
+    // Kernel di update specializzati sulle funzionalita' attive (rami spenti eliminati in compilazione),
+    // compilati in background al primo uso; false = sempre il programma generico con i selettori uniform
+    bool isShaderVariantsEnabled() const { return m_shaderVariantsEnabled; }
+    void setShaderVariantsEnabled(bool enabled) { m_shaderVariantsEnabled = enabled; }
+    bool isUpdateVariantActive() const { return m_updateVariantActive; }
+    int  getUpdateVariantCount() const { return static_cast<int>(m_updateVariants.size()); }
+
+    // Sensing multi-scala: piramide mip della trail map, i sensori lontani leggono un livello grosso.
+    // All'accensione la piramide viene costruita subito: l'update del passo dopo legge gia' i livelli grossi.
+    bool isTrailPyramidEnabled() const { return m_trailPyramidEnabled; }
+    void setTrailPyramidEnabled(bool enabled);
+    float getPyramidBaseDistance() const { return m_pyramidBaseDistance; }
+    void setPyramidBaseDistance(float val) { m_pyramidBaseDistance = std::clamp(val, 1.0f, 256.0f); }
+    int  getTrailLevels() const { return m_trailLevels; }
+
+    // Comportamento per specie: moltiplicatori dei parametri globali. L'update li legge da una tabella
+    // SSBO (una riga per specie, ricaricata solo quando cambia) invece che da rami sulla specie: le
+    // particelle restano raggruppate per specie e ogni workgroup legge una sola riga.
+    struct SpeciesSettings {
+        float sensorScale = 1.0f;        // distanza dei sensori
+        float sensorAngleScale = 1.0f;   // apertura dei sensori
+        float turnScale = 1.0f;          // angolo di sterzata
+        float speedScale = 1.0f;
+        float depositScale = 1.0f;
+        float alignmentScale = 1.0f;     // pesi dei boids
+        float separationScale = 1.0f;
+        float cohesionScale = 1.0f;
+        float hueShift = 0.0f;           // rotazione della tinta del deposito (formati a colori)
+    };
+    const SpeciesSettings& getSpeciesSettings(int species) const { return m_speciesSettings[std::clamp(species, 0, kSpeciesCount - 1)]; }
+    void setSpeciesSettings(int species, const SpeciesSettings& settings);
+    float getSpeciesSensorScale(int species) const { return getSpeciesSettings(species).sensorScale; }
+    void setSpeciesSensorScale(int species, float val) {
+        if (species >= 0 && species < kSpeciesCount) m_speciesSettings[species].sensorScale = std::clamp(val, 0.1f, 8.0f);
+    }
+
+    // Specie attive (1 .. kSpeciesCount): un cambio riassegna le specie delle particelle a blocchi di indici
+    int  getSpeciesCount() const { return m_speciesCount; }
+    void setSpeciesCount(int count) { m_speciesCount = std::clamp(count, 1, kSpeciesCount); }
+    
+    // Trail per specie: la specie s deposita nel canale s (R, G, B) e i sensori pesano i canali
+    // con la riga s della matrice di interazione (w pesa la densita' totale). Serve un formato a 3+ canali.
+    bool isSpeciesChannelsEnabled() const { return m_speciesChannels; }
+    void setSpeciesChannelsEnabled(bool enabled) { m_speciesChannels = enabled; }
+    bool isSpeciesChannelsActive() const { return m_speciesChannels && getTextureFormatInfo(m_textureFormat).channels >= kSpeciesCount; }
+    // Indici come setSpeciesInteraction (colonna kSpeciesCount = densita' totale); fuori intervallo 0
+    float getSpeciesInteraction(int species, int column) const {
+        if (species < 0 || species >= kSpeciesCount || column < 0 || column > kSpeciesCount) return 0.0f;
+        return m_speciesMatrix[species][column];
+    }
+    void setSpeciesInteraction(int species, int column, float weight) {
+        if (species < 0 || species >= kSpeciesCount || column < 0 || column > kSpeciesCount) return;
+        weight = std::clamp(weight, -4.0f, 4.0f);
+        if (m_speciesMatrix[species][column] != weight) {
+            m_speciesMatrix[species][column] = weight;
+            m_speciesMatrixDirty = true;
+        }
+    }
+
+    // Campo di reazione-diffusione (Gray-Scott) accoppiato alle particelle: depositano feed (sorgente di V)
+    // e sentono V. Alla risoluzione della trail map, texture RGBA16F (U, V, feed).
+    bool  isReactionEnabled() const { return m_reactionEnabled; }
+    void  setReactionEnabled(bool enabled) { m_reactionEnabled = enabled; }
+    void  setReactionParams(float feed, float kill, float diffU, float diffV) {
+        m_reactionFeed = feed; m_reactionKill = kill; m_reactionDiffU = diffU; m_reactionDiffV = diffV;
+    }
+    int   getReactionSubsteps() const { return m_reactionSubsteps; }
+    void  setReactionSubsteps(int substeps) { m_reactionSubsteps = std::clamp(substeps, 1, kMaxReactionSubsteps); }
+    // deposit = feed per particella, senseWeight = peso di V nei sensori (negativo = repulsione)
+    void  setReactionCoupling(float deposit, float senseWeight) { m_reactionDeposit = deposit; m_reactionSenseWeight = senseWeight; }
+    void  resetReactionField();
+    GLuint getReactionTexture() const { return m_fieldIDIn; }
+
+    // Diffusione della trail: box blur diretto di raggio R (R = 1 e' il 3x3 originale) oppure
+    // convoluzione FFT su toro con kernel arbitrario, su GPU o CPU (readback + upload, riferimento)
+    enum class DiffusionMode { Direct = 0, FftGpu, FftCpu, Count };
+    DiffusionMode getDiffusionMode() const { return m_diffusionMode; }
+    void  setDiffusionMode(DiffusionMode mode) { m_diffusionMode = mode; }
+    int   getDiffusionRadius() const { return m_diffusionRadius; }
+    void  setDiffusionRadius(int radius) { m_diffusionRadius = std::clamp(radius, 1, 256); }
+    Fft::KernelType getFftKernel() const { return m_fftKernel; }
+    void  setFftKernel(Fft::KernelType kernel) { m_fftKernel = kernel; }
+    // Crescita stile Lenia applicata al risultato della convoluzione (solo modalita' FFT)
+    void  setLeniaGrowth(bool enabled, float mu, float sigma, float dt) {
+        m_leniaGrowth = enabled; m_leniaMu = mu; m_leniaSigma = std::max(sigma, 1e-4f); m_leniaDt = dt;
+    }
+    // La FFT GPU tiene una linea in shared memory: lato paddato <= Fft::kMaxGpuLength
+    bool  isFftGpuAvailable(int radius) const;
+    // Misura sincrona (glFinish): ms medi di un pass di diffusione. Scrive solo la texture di output
+    // del ping-pong, quindi non altera lo stato della simulazione.
+    float measureDiffusionCost(DiffusionMode mode, int radius, int iterations);
+
+    // Forze di zona: densita' per specie su una griglia grossa (celle di cellSize px), ridotta ogni
+    // step in una summed-area table GPU (SSBO binding kZoneSatBinding, uvec4 per cella: specie 0..2 + totale).
+    // Ogni particella legge la popolazione di rettangoli arbitrari in O(1) e subisce una forza debole
+    // (attrazione/repulsione verso la concentrazione di ogni specie, vortice attorno) pesata dalla quota della specie.
+    static constexpr int kZoneCountBinding = 7;
+    static constexpr int kZoneSatBinding = 8;
+    bool  isZoneForcesEnabled() const { return m_zoneForcesEnabled; }
+    void  setZoneForcesEnabled(bool enabled) { m_zoneForcesEnabled = enabled; }
+    float getZoneCellSize() const { return m_zoneCellSize; }
+    void  setZoneCellSize(float size) { m_zoneCellSize = std::clamp(size, 4.0f, 256.0f); }
+    int   getZoneRadius() const { return m_zoneRadius; }
+    void  setZoneRadius(int cells) { m_zoneRadius = std::clamp(cells, 1, 64); }
+    float getZoneStrength() const { return m_zoneStrength; }
+    void  setZoneStrength(float strength) { m_zoneStrength = std::clamp(strength, 0.0f, 1.0f); }
+    // attraction < 0 = repulsione, swirl > 0 = vortice antiorario, < 0 orario
+    void  setSpeciesZoneForce(int species, float attraction, float swirl) {
+        if (species < 0 || species >= kSpeciesCount) return;
+        m_speciesZoneForce[species][0] = std::clamp(attraction, -4.0f, 4.0f);
+        m_speciesZoneForce[species][1] = std::clamp(swirl, -4.0f, 4.0f);
+    }
+    int   getZoneGridWidth() const { return m_zoneGridWidth; }
+    int   getZoneGridHeight() const { return m_zoneGridHeight; }
+    // SAT dell'ultimo step, (W+1) x (H+1) uvec4 con riga/colonna 0 a zero
+    GLuint getZoneSatBuffer() const { return m_zoneSatBuffer; }
+
     float getTurnAngle() const { return m_turnAngle; }
     void setTurnAngle(float val) { m_turnAngle = val; }
     
@@ -60,14 +327,7 @@ public:
     // Trails / post
     float getTrailFade() const { return m_trailFade; }
     void setTrailFade(float val) { m_trailFade = std::clamp(val, 0.5f, 0.9999f); }
-    float getToneExposure() const { return m_toneExposure; }
-    void setToneExposure(float val) { m_toneExposure = std::clamp(val, 0.01f, 20.0f); }
-    float getAutoDimThreshold() const { return m_autoDimThreshold; }
-    void setAutoDimThreshold(float val) { m_autoDimThreshold = std::clamp(val, 0.0f, 1.0f); }
-    float getAutoDimStrength() const { return m_autoDimStrength; }
-    void setAutoDimStrength(float val) { m_autoDimStrength = std::clamp(val, 0.0f, 1.0f); }
-    float getAutoDimGlobal() const { return m_autoDimGlobal; }
-    void setAutoDimGlobal(float val) { m_autoDimGlobal = std::clamp(val, 0.0f, 20.0f); }
+    // (tone mapping e auto-dim sono applicati solo in visualizzazione, vedi RenderPipeline)
     
     // Motion tuning
     float getInertia() const { return m_inertia; }
@@ -142,48 +402,288 @@ public:
 
 private:
     void createComputeShaders();
+    void createParticleBuffers();
+    void downloadParticles(int start, int count, std::vector<GpuParticle>& out);
+    // Lega gli stream del buffer indicato ai binding di ingresso (readonly) o di uscita dello shader
+    void bindParticleStreams(int buffer, bool output);
+    // Alloca (copiando lo stato corrente) o libera il secondo buffer delle particelle
+    void ensureParticleBackBuffer(bool needed);
     void createTextures();
     void initializeParticles();
     void createGridBuffers();  // New: Grid initialization
     void rebuildGridIfNeeded();
+    void createZoneBuffers();
+    void buildZoneDensity(int activeCount);
+    void sampleActivity();
+    void readActivityMetrics();
+    void releaseActivityBuffers();
+    void updateTrailSize();
+    void runBlurPass();
+    void runDirectBlur(int radius);
+    void runFftGpu(int radius);
+    void runFftCpu(int radius);
+    void prepareFftSpectrum(int radius, bool uploadToGpu);
+    void runReactionPass();
+    void createReactionField();
+    void buildTrailPyramid();
+    Deterministic::Params deterministicParams() const;
+    void resetDeterministic();
+    void stepDeterministic();
+    void checkDeterministicHash();
+    void releaseDeterministicBuffers();
 
 private:
+    // SSBO propri degli shader piu' carichi (update: griglia, ParticleNext, tabella specie, SAT delle zone;
+    // compact), oltre a quelli del prelude
+    static constexpr int kMaxShaderOwnStorageBlocks = 4;
+
     int   m_maxParticles;
+    size_t m_particleBudgetBytes;   // byte per buffer, fissati dal costruttore
+    ParticleLayout m_particleLayout;
+    int   m_maxComputeStorageBlocks;   // 0 = non ancora letto (nessun contesto)
+    bool  m_backBufferFailed;       // GL_OUT_OF_MEMORY sul secondo buffer: non si riprova fino al prossimo layout
+    size_t m_particleStreamOffsets[Particles::kMaxStreams];  // regione di ogni stream nei due buffer
     int   m_activeParticles;
     int   m_targetParticles;
     bool  m_rampingUp;
 
     int   m_width;
     int   m_height;
+    int   m_trailDivisor;
+    int   m_trailWidth;   // = ceil(m_width / m_trailDivisor)
+    int   m_trailHeight;
     TextureFormat m_textureFormat;
     bool  m_initialized;
 
-    void  resetParticlePositions(int startIdx, int count);
+    // Semina [start, start + count) in GPU su tutti i buffer delle particelle allocati
+    void  seedParticles(int start, int count, SeedDistribution distribution);
+
+    uint32_t m_randomSeed;
+    uint32_t m_rngStep;        // passi di update dall'ultimo seme (uParticleRngStep del layout compatto)
+    uint32_t m_seedBatch;      // semine dall'ultimo seme: cambia le posizioni delle particelle riseminate
+    SeedDistribution m_seedDistribution;
+    GLuint   m_seedProgramID;
+    GLuint   m_seedImageTexture;   // R8, 0 = la distribuzione Image usa la trail
+
+    // Emettitori: durata di vita per particella (vec2 eta' / durata, segue i record nella compattazione),
+    // conteggio in GPU (due GpuParticleCount: corrente e pending) e tabella degli emettitori del passo
+    bool     m_emittersEnabled;
+    bool     m_emittersReady;         // conteggio azzerato per i buffer correnti
+    std::vector<ParticleEmitter> m_emitters;
+    std::vector<float> m_emitterCarry;  // frazione di particella non ancora emessa, per emettitore
+    uint32_t m_emittedTotal;
+    GLuint   m_compactProgramID;
+    GLuint   m_emitProgramID;
+    GLuint   m_particleLifeBuffers[2];  // [0] = durate delle particelle correnti
+    GLuint   m_particleCountBuffer;
+    GLuint   m_compactGroupBuffer;
+    GLuint   m_emitterBuffer;
+    void     runEmitters(float dt);
+    void     releaseEmitterBuffers();
+    // Dispatch del programma in uso su un pass per particella: conteggio dalla CPU o, con gli emettitori,
+    // indiretto dal conteggio in GPU
+    void     dispatchParticles(int count, int groupSize);
 
-    // Buffer particelle in double buffering
+    // Buffer particelle: double buffering solo quando l'update legge altre particelle (boids, collisioni),
+    // altrimenti ogni particella legge e riscrive il proprio record in place e m_particleBuffers[1] = 0
     GLuint m_particleBuffers[2];
     int    m_currentBuffer;
+    size_t m_particleBufferSize;   // byte di un buffer (stream + padding di allineamento)
 
     // Due texture per ping-pong
     GLuint m_textureIDIn;
     GLuint m_textureIDOut;
 
+    // Livelli mip della trail map (0 = piena risoluzione) e sampler con filtro mipmap per il sensing
+    static constexpr int kMaxTrailLevels = 6;
+    int    m_trailLevels;
+    GLuint m_trailLodSampler;
+
+    // Campo Gray-Scott (ping-pong, RGBA16F alla risoluzione della trail)
+    static constexpr int kMaxReactionSubsteps = 16;
+    static constexpr int kReactionFusedSubsteps = 4;   // MAX_SUBSTEPS in reaction.comp
+    GLuint m_fieldIDIn;
+    GLuint m_fieldIDOut;
+    GLuint m_reactionProgramID;
+
+    // Convoluzione FFT: buffer complessi (coppie di canali) e spettro del kernel, ricalcolato al cambio
+    // di kernel, raggio o dimensione paddata
+    GLuint m_fftPackProgramID;
+    GLuint m_fftProgramID;
+    GLuint m_fftMultiplyProgramID;
+    GLuint m_fftUnpackProgramID;
+    GLuint m_fftDataBuffer;
+    GLuint m_fftKernelBuffer;
+    size_t m_fftDataBytes;
+    int    m_fftPaddedWidth;
+    int    m_fftPaddedHeight;
+    int    m_fftSpectrumRadius;
+    Fft::KernelType m_fftSpectrumKernel;
+    bool   m_fftSpectrumOnGpu;
+    std::vector<Fft::Complex> m_fftSpectrum;
+    std::vector<float> m_fftCpuField;
+    GLuint m_diffusionQueries[2];
+
     // Shader compute
-    GLuint m_updateProgramID;
+    GLuint m_updateProgramID;   // update/blur/mip/detTrail: alias dei programmi di m_textureFormat nella cache
     GLuint m_blurProgramID;
+    GLuint m_mipProgramID;
+
+    // Programmi compilati con il define FORMAT_* della trail: uno per formato, compilati al primo uso e
+    // tenuti fino alla distruzione, cosi' un cambio di formato gia' visto non ricompila nulla
+    struct FormatPrograms {
+        GLuint update = 0;     // dipende anche dal layout delle particelle
+        GLuint blur = 0;
+        GLuint mip = 0;
+        GLuint detTrail = 0;
+        GLuint resample = 0;
+    };
+    FormatPrograms m_formatPrograms[static_cast<int>(TextureFormat::Count)];
+    const FormatPrograms& formatPrograms(TextureFormat format);
+    void selectFormatPrograms();
+    void releaseFormatPrograms(bool layoutOnly);
+
+    // Varianti dell'update specializzate sulle funzionalita' attive (selettori come #define, vedi update.comp).
+    // Chiave: bit delle funzionalita' + formato della trail; dipendono dal layout, quindi cadono con gli update
+    // in releaseFormatPrograms. Una variante nuova si avvia senza attenderla e il passo usa il programma
+    // generico del formato finche' non e' pronta; oltre kMaxUpdateVariants si scarta la meno usata di recente.
+    static constexpr int kMaxUpdateVariants = 24;
+    static constexpr int kVariantWaitSteps = 4;   // senza parallel_shader_compile: passi prima di leggere lo stato
+    struct UpdateVariant {
+        ProgramCache::Pending pending;
+        int      waitSteps = 0;
+        bool     ready = false;
+        bool     failed = false;
+        uint32_t lastUsed = 0;
+    };
+    std::unordered_map<uint32_t, UpdateVariant> m_updateVariants;
+    bool     m_shaderVariantsEnabled;
+    bool     m_parallelShaderCompile;   // GL_ARB/KHR_parallel_shader_compile presente
+    bool     m_updateVariantActive;     // l'ultimo passo ha usato una variante specializzata
+    uint32_t m_updateVariantClock;
+    uint32_t updateVariantKey(bool samplerSensing, bool reactionEnabled, int mouseMode) const;
+    std::string updateVariantDefines(uint32_t key) const;
+    GLuint   selectUpdateProgram(bool samplerSensing, bool reactionEnabled, int mouseMode);
+    void     pollUpdateVariants();
+
+    // Resize con stato: texture ricampionate nel nuovo formato, posizioni riscalate in place
+    GLuint m_rescaleProgramID;
+    void resampleTexture(GLuint source, GLuint dest, int width, int height, TextureFormat format);
+    void rescaleParticles(float scaleX, float scaleY);
 
     // Parametri di simulazione
     float m_sensorDistance;
     float m_sensorAngle;
     float m_turnAngle;
+    bool  m_samplerSensing;
+    bool  m_trailPyramidEnabled;
+    float m_pyramidBaseDistance;   // distanza (texel trail) letta al livello 0; ogni raddoppio sale di un livello
+
+    // Specie: impostazioni, tabella dell'update (SSBO, binding 27) e riassegnazione dopo un cambio del numero
+    SpeciesSettings m_speciesSettings[kSpeciesCount];
+    int    m_speciesCount;
+    int    m_speciesAssigned;      // numero di specie con cui sono assegnate le particelle correnti
+    float  m_speciesTable[kSpeciesCount][12];   // righe std430 caricate in m_speciesTableBuffer
+    bool   m_speciesTableValid;
+    GLuint m_speciesTableBuffer;
+    GLuint m_speciesProgramID;
+    void   uploadSpeciesTable();
+    void   assignSpecies();
+
+    // Parametri dell'update in uniform block std140 (update.comp), agganciati una volta in initialize():
+    // SimParams cambia solo dalla UI, StepParams con dt e mouse. Entrambi si ricaricano solo se diversi
+    // dall'ultima copia, quindi i sotto-passi con gli stessi valori non toccano i buffer.
+    static constexpr int kSimParamsBinding = 1;
+    static constexpr int kStepParamsBinding = 2;
+    struct UpdateSimParams {
+        float   color1[3];
+        float   colorOffset;
+        float   color2[3];
+        int32_t colorSource;
+        float   zoneSpeciesForce[kSpeciesCount][4];   // vec4 per specie (std140), xy usati
+        float   simSize[2];
+        float   trailScale[2];
+        int32_t trailSize[2];
+        int32_t zoneGridSize[2];
+        int32_t boundaryMode;
+        int32_t physarumEnabled;
+        float   physarumIntensity;
+        int32_t reactionEnabled;
+        float   reactionDeposit;
+        float   reactionSenseWeight;
+        int32_t speciesChannels;
+        int32_t samplerSensing;
+        int32_t pyramidEnabled;
+        float   pyramidBaseDistance;
+        float   pyramidMaxLod;
+        float   speedMin;
+        float   speedMax;
+        float   inertia;
+        float   restitution;
+        float   randomWeight;
+        int32_t boidsEnabled;
+        float   boidsRadius;
+        float   cellSize;
+        int32_t gridWidth;
+        int32_t gridHeight;
+        int32_t collisionsEnabled;
+        float   collisionRadius;
+        int32_t zoneForcesEnabled;
+        float   zoneCellSize;
+        int32_t zoneRadius;
+        float   zoneStrength;
+        int32_t mouseFalloff;
+        float   mouseStrength;
+        float   mouseGaussianSigma;
+        float   mouseOscFreq;
+        int32_t mouseRingOverlay;
+        float   mouseRingRadius;
+        float   colorSpeedMin;
+        float   colorSpeedMax;
+        float   padding;
+    };
+    struct UpdateStepParams {
+        float   mousePos[2];
+        float   dt;
+        int32_t mousePressed;
+        int32_t mouseMode;
+        float   padding[3];
+    };
+    UpdateSimParams  m_simParams;
+    UpdateStepParams m_stepParams;
+    bool   m_simParamsValid;
+    bool   m_stepParamsValid;
+    GLuint m_simParamsUBO;
+    GLuint m_stepParamsUBO;
+    void   uploadUpdateParams(float dt, float mouseX, float mouseY, bool mousePressed, int mouseMode,
+                              bool samplerSensing, bool reactionEnabled);
+    float  m_submitMs;
+    int    m_submitSamples;
+
+    bool  m_reactionEnabled;
+    float m_reactionFeed;
+    float m_reactionKill;
+    float m_reactionDiffU;
+    float m_reactionDiffV;
+    int   m_reactionSubsteps;
+    float m_reactionDeposit;
+    float m_reactionSenseWeight;
+    DiffusionMode m_diffusionMode;
+    int   m_diffusionRadius;
+    Fft::KernelType m_fftKernel;
+    bool  m_leniaGrowth;
+    float m_leniaMu;
+    float m_leniaSigma;
+    float m_leniaDt;
+    bool  m_speciesChannels;
+    // Righe vec4 (std140): xyz = peso dei canali delle specie, w = peso della densita' totale
+    float m_speciesMatrix[kSpeciesCount][4];
+    bool  m_speciesMatrixDirty;
+    GLuint m_speciesMatrixUBO;
     float m_speedMin;
     float m_speedMax;
     float m_speed;
     float m_trailFade;
-    float m_toneExposure;
-    float m_autoDimThreshold;
-    float m_autoDimStrength;
-    float m_autoDimGlobal;
     float m_inertia;
     float m_restitution;
     float m_randomWeight;
@@ -235,8 +735,68 @@ private:
     // Shader for rebuilding grid
     GLuint m_gridResetProgramID;  // Clears the grid
     GLuint m_gridBuildProgramID;  // Atomic-adds particles
+
+    // Densita' per specie a zone (contatori atomici + summed-area table)
+    bool   m_zoneForcesEnabled;
+    float  m_zoneCellSize;
+    int    m_zoneRadius;
+    float  m_zoneStrength;
+    float  m_speciesZoneForce[kSpeciesCount][2];
+    int    m_zoneGridWidth;
+    int    m_zoneGridHeight;
+    float  m_zoneBufferCellSize;  // cella con cui sono stati allocati i buffer
+    GLuint m_zoneCountBuffer;
+    GLuint m_zoneSatBuffer;
+    GLuint m_zoneCountProgramID;
+    GLuint m_zoneSatProgramID;
     
-    // Profiling
-    GLuint m_timeQueries[4]; // Start, Grid, Update, Blur
+    // Pass di un passo di simulazione: indici stabili dei timer del grafo, barriere derivate dagli accessi
+    enum class SimPass { Emitters, Grid, Zones, Reaction, Blur, Update, Pyramid, Activity, Count };
+    PassGraph m_passGraph;
+    // I tempi del grafo arrivano due passi dopo: condizioni in cui e' stato registrato ciascun set
+    bool   m_timeQuerySteady[2];          // set registrato a regime (conta per le medie per formato)
+    TextureFormat m_timeQueryFormat[2];   // formato attivo quando il set e' stato registrato
+    bool   m_timeQuerySampler[2];         // sensing via sampler (medie per modalita' di sensing)
+    float  m_lastGridMs;
+    float  m_lastUpdateMs;
+    float  m_lastBlurMs;
+    float  m_lastReactionMs;
+    float  m_lastEmitterMs;
+    FormatTiming m_formatTimings[static_cast<int>(TextureFormat::Count)];
+    FormatTiming m_sensingTimings[2];
+
+    // Metriche di attivita' (stato stazionario)
+    bool   m_activityEnabled;
+    int    m_activityInterval;
+    int    m_activityStepCounter;
+    GLuint m_activityProgramID;
+    GLuint m_activityTileBuffer;
+    GLuint m_activityPartialBuffer;
+    GLuint m_activityMetricBuffers[2];
+    GLsync m_activityFences[2];
+    int    m_activitySet;
+    int    m_activityTilesX;
+    int    m_activityTilesY;
+    float  m_activityPrevEnergy;
+    ActivityMetrics m_activity;
     void printPerformanceStats();
+
+    // Modalita' deterministica: agenti (uvec4), trail uint ping-pong, depositi e tabella delle direzioni
+    bool     m_deterministicEnabled;
+    bool     m_deterministicReference;
+    bool     m_deterministicReady;       // buffer seminati per la configurazione corrente
+    int      m_deterministicHashInterval;
+    int      m_deterministicAgents;
+    int      m_deterministicTrailWidth;
+    int      m_deterministicTrailHeight;
+    uint32_t m_deterministicStep;
+    uint64_t m_deterministicHash;
+    bool     m_deterministicDiverged;
+    GLuint   m_detUpdateProgramID;
+    GLuint   m_detTrailProgramID;
+    GLuint   m_detAgentBuffer;
+    GLuint   m_detTrailBuffers[2];       // [0] = trail corrente
+    GLuint   m_detDepositBuffer;
+    GLuint   m_detDirectionBuffer;
+    Deterministic::Simulation m_detReference;
 };
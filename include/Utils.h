@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <string>
+#include <vector>
 // Librerie OpenGL e GLFW
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -74,6 +76,23 @@ namespace Utils
     HardwareInfo getHardwareInfo();
     std::string makeHardwarePresetName(const HardwareInfo& info);
 
+    //------------------------------------------------------------
+    // Memoria video vista da OpenGL: GL_NVX_gpu_memory_info (NVIDIA) o GL_ATI_meminfo (AMD).
+    // Tutto a zero se il driver non espone nessuna delle due (Intel, llvmpipe): resta la memoria DXGI.
+    struct GpuMemoryInfo
+    {
+        uint64_t totalBytes = 0;       // memoria dedicata (solo NVX)
+        uint64_t availableBytes = 0;   // libera al momento della query
+        std::string source;            // estensione usata
+    };
+    GpuMemoryInfo queryGpuMemory();
+
+    //------------------------------------------------------------
+    // Immagine in scala di grigi (8 bit, righe dall'alto) da un file Netpbm: PGM (P2/P5) o PPM (P3/P6,
+    // luminanza Rec. 709), maxval fino a 65535. Nessuna dipendenza esterna: altri formati vanno convertiti.
+    // @throw std::runtime_error se il file manca, non e' Netpbm o e' troncato
+    void loadLuminanceImage(const std::string& path, std::vector<uint8_t>& luminance, int& width, int& height);
+
     //------------------------------------------------------------
     // Funzioni per inizializzare GLAD e configurare OpenGL
     bool initializeGLAD();
@@ -3,14 +3,27 @@
 in vec2 vTexCoord;
 out vec4 FragColor;
 
-uniform sampler2D uTexture;
-uniform float uTime;
-uniform int   uColorMode; // 0=Original, 1=Legacy, 2=Neon, 3=Bismuth, 4=Psycho
-uniform vec3  uColor1;
-uniform vec3  uColor2;
-uniform float uNeonSpeed;
-uniform float uNeonRange;
-uniform vec3  uBackgroundColor;
+layout(binding = 0) uniform sampler2D uTexture;
+
+// Tone mapping (LUT 1D): R = curva log, G = fattore auto-dim in funzione della luminanza
+layout(binding = 1) uniform sampler1D uToneLut;
+
+// Campo di reazione Gray-Scott (G = V), sommato sopra la trail
+layout(binding = 2) uniform sampler2D uReactionField;
+
+// Parametri del pass finale (RenderPipeline::RenderParams, stesso ordine), ricaricati solo quando cambiano
+layout(std140, binding = 3) uniform RenderParams {
+    vec3  uColor1;
+    float uTime;
+    vec3  uColor2;
+    float uNeonSpeed;
+    vec3  uBackgroundColor;
+    float uNeonRange;
+    vec2  uToneLutScaleBias;
+    int   uColorMode;       // 0=Original, 1=Legacy, 2=Neon, 3=Bismuth, 4=Psycho
+    int   uTrailChannels;   // 1-2 = densita', 3-4 = colore
+    float uReactionOverlay;
+};
 
 // Helper: HSV to RGB
 vec3 hsv2rgb(vec3 c) {
@@ -24,9 +37,20 @@ vec3 palette( in float t, in vec3 a, in vec3 b, in vec3 c, in vec3 d ) {
     return a + b*cos( 6.28318*(c*t+d) );
 }
 
+float toneLookup(float x, int channel) {
+    float u = x * uToneLutScaleBias.x + uToneLutScaleBias.y;
+    return texture(uToneLut, u)[channel];
+}
+
 void main()
 {
     vec4 texVal = texture(uTexture, vTexCoord);
+
+    // Stato lineare -> valore visualizzato (una volta per frame, non per step di simulazione)
+    vec3 toned = vec3(toneLookup(texVal.r, 0), toneLookup(texVal.g, 0), toneLookup(texVal.b, 0));
+    float lum = (uTrailChannels <= 2) ? toned.r : dot(toned, vec3(0.299, 0.587, 0.114));
+    texVal.rgb = toned * toneLookup(lum, 1);
+
     float alpha = clamp(texVal.a, 0.0, 1.0);
     
     // Global Density Estimation (using Red channel)
@@ -87,5 +111,9 @@ void main()
     }
     
     vec3 finalColor = mix(uBackgroundColor, baseColor, alpha);
+    if (uReactionOverlay > 0.0) {
+        float v = texture(uReactionField, vTexCoord).g;
+        finalColor += uColor2 * v * uReactionOverlay;
+    }
     FragColor = vec4(finalColor, 1.0);
 }
@@ -0,0 +1,217 @@
+#include "DeterministicSimulation.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    constexpr double kPi = 3.14159265358979323846;
+
+    // >> aritmetico portabile (floor della divisione, come int >> in GLSL)
+    int32_t shiftRight(int32_t value, int bits)
+    {
+        return value >= 0 ? (value >> bits) : ~(~value >> bits);
+    }
+
+    int32_t wrap(int32_t value, int32_t size)
+    {
+        while (value < 0) value += size;
+        while (value >= size) value -= size;
+        return value;
+    }
+
+    int trailIndex(const Deterministic::Params& params, int32_t x, int32_t y)
+    {
+        int cx = (x >> 16) / params.trailDivisor;
+        int cy = (y >> 16) / params.trailDivisor;
+        return cy * params.trailWidth + cx;
+    }
+}
+
+namespace Deterministic
+{
+    uint32_t angleToSteps(float radians)
+    {
+        double steps = std::floor(static_cast<double>(radians) / (2.0 * kPi) * kDirectionSteps + 0.5);
+        return static_cast<uint32_t>(static_cast<int64_t>(steps)) & kDirectionMask;
+    }
+
+    int32_t toFixed(float value, int fractionBits, int32_t minValue, int32_t maxValue)
+    {
+        double scaled = std::floor(static_cast<double>(value) * static_cast<double>(1 << fractionBits) + 0.5);
+        return static_cast<int32_t>(std::clamp(scaled, static_cast<double>(minValue), static_cast<double>(maxValue)));
+    }
+
+    const std::vector<int32_t>& directionTable()
+    {
+        // Solo il primo quadrante passa da cos(): gli altri sono simmetrie esatte,
+        // cosi' la tabella non dipende dagli ultimi ulp della libm oltre l'arrotondamento Q15
+        static const std::vector<int32_t> table = [] {
+            std::vector<int32_t> t(kDirectionSteps * 2);
+            const uint32_t quarter = kDirectionSteps / 4;
+            std::vector<int32_t> cosQ(quarter + 1);
+            for (uint32_t i = 0; i <= quarter; ++i) {
+                double angle = 2.0 * kPi * static_cast<double>(i) / static_cast<double>(kDirectionSteps);
+                cosQ[i] = static_cast<int32_t>(std::floor(std::cos(angle) * 32767.0 + 0.5));
+            }
+            cosQ[quarter] = 0;
+            for (uint32_t i = 0; i < kDirectionSteps; ++i) {
+                uint32_t q = i / quarter;
+                uint32_t r = i % quarter;
+                int32_t c, s;
+                switch (q) {
+                case 0:  c =  cosQ[r];           s =  cosQ[quarter - r]; break;
+                case 1:  c = -cosQ[quarter - r]; s =  cosQ[r];           break;
+                case 2:  c = -cosQ[r];           s = -cosQ[quarter - r]; break;
+                default: c =  cosQ[quarter - r]; s = -cosQ[r];           break;
+                }
+                t[i * 2 + 0] = c;
+                t[i * 2 + 1] = s;
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    uint32_t hash(uint32_t value)
+    {
+        uint32_t state = value * 747796405u + 2891336453u;
+        uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    uint32_t random(uint32_t seed, uint32_t stream, uint32_t index)
+    {
+        return hash(index ^ hash(stream ^ hash(seed)));
+    }
+
+    void seedAgents(const Params& params, int count, std::vector<Agent>& out)
+    {
+        out.resize(std::max(0, count));
+        const uint64_t widthQ = static_cast<uint64_t>(params.width) << 16;
+        const uint64_t heightQ = static_cast<uint64_t>(params.height) << 16;
+        for (int i = 0; i < count; ++i) {
+            uint32_t index = static_cast<uint32_t>(i);
+            Agent& a = out[i];
+            a.x = static_cast<int32_t>((random(params.seed, kSeedStream + 0u, index) * widthQ) >> 32);
+            a.y = static_cast<int32_t>((random(params.seed, kSeedStream + 1u, index) * heightQ) >> 32);
+            a.heading = random(params.seed, kSeedStream + 2u, index) & kDirectionMask;
+            a.species = random(params.seed, kSeedStream + 3u, index) % static_cast<uint32_t>(kSpeciesCount);
+        }
+    }
+
+    uint64_t fnv1a(const void* data, size_t bytes, uint64_t hash)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < bytes; ++i) {
+            hash ^= p[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    uint64_t stateHash(const Agent* agents, size_t agentCount, const uint32_t* trail, size_t cellCount)
+    {
+        uint64_t h = fnv1a(agents, agentCount * sizeof(Agent));
+        return fnv1a(trail, cellCount * sizeof(uint32_t), h);
+    }
+
+    std::string glslDefinitions()
+    {
+        return "#define DET_DIRECTION_MASK " + std::to_string(kDirectionMask) + "u\n"
+               "#define DET_DIRECTION_STEPS " + std::to_string(kDirectionSteps) + "u\n"
+               "#define DET_TRAIL_MAX " + std::to_string(kTrailMax) + "u\n"
+               "#define DET_TRAIL_ONE " + std::to_string(kTrailOne) + ".0\n"
+               "#define DET_SPECIES_COUNT " + std::to_string(kSpeciesCount) + "\n";
+    }
+
+    void Simulation::reset(const Params& params, int agentCount)
+    {
+        seedAgents(params, agentCount, m_agents);
+        m_trailWidth = params.trailWidth;
+        m_trailHeight = params.trailHeight;
+        size_t cells = static_cast<size_t>(m_trailWidth) * m_trailHeight;
+        m_trail.assign(cells, 0u);
+        m_nextTrail.assign(cells, 0u);
+        m_deposit.assign(cells, 0u);
+        m_depositCell.assign(m_agents.size(), 0u);
+        m_step = 0;
+    }
+
+    void Simulation::step(const Params& params, int threads)
+    {
+        const std::vector<int32_t>& dirs = directionTable();
+        const int32_t widthQ = params.width << 16;
+        const int32_t heightQ = params.height << 16;
+        const uint32_t turnLeft = params.turnAngle & kDirectionMask;
+        const uint32_t turnRight = (kDirectionSteps - turnLeft) & kDirectionMask;
+        const uint32_t stepIndex = m_step;
+
+        // 1. Agenti: sensing sulla trail del passo precedente, sterzata, movimento. Il deposito e' solo
+        // annotato: la somma per cella e' commutativa, il giro seriale sotto non cambia il risultato.
+        Parallel::forRange(static_cast<int>(m_agents.size()), threads, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                Agent& a = m_agents[i];
+                const int32_t distance = params.sensorDistance[a.species];
+                auto sense = [&](uint32_t heading) {
+                    int32_t sx = wrap(a.x + shiftRight(dirs[heading * 2 + 0] * distance, 3), widthQ);
+                    int32_t sy = wrap(a.y + shiftRight(dirs[heading * 2 + 1] * distance, 3), heightQ);
+                    return m_trail[trailIndex(params, sx, sy)];
+                };
+                uint32_t front = sense(a.heading);
+                uint32_t left = sense((a.heading + params.sensorAngle) & kDirectionMask);
+                uint32_t right = sense((a.heading - params.sensorAngle) & kDirectionMask);
+
+                uint32_t r = random(params.seed, stepIndex, static_cast<uint32_t>(i));
+                uint32_t heading = a.heading;
+                if (front > left && front > right) {
+                    // dritto
+                } else if (front < left && front < right) {
+                    heading += (r & 1u) ? turnLeft : turnRight;
+                } else if (left > right) {
+                    heading += turnLeft;
+                } else if (right > left) {
+                    heading += turnRight;
+                } else {
+                    heading += (r & 2u) ? 1u : kDirectionMask;   // pari: un passo di tabella a caso
+                }
+                a.heading = heading & kDirectionMask;
+
+                a.x = wrap(a.x + shiftRight(dirs[a.heading * 2 + 0] * params.speed, 7), widthQ);
+                a.y = wrap(a.y + shiftRight(dirs[a.heading * 2 + 1] * params.speed, 7), heightQ);
+                m_depositCell[i] = static_cast<uint32_t>(trailIndex(params, a.x, a.y));
+            }
+        });
+        for (uint32_t cell : m_depositCell) m_deposit[cell] += params.deposit;
+
+        // 2. Trail + depositi (saturati), media 3x3 su toro e decadimento
+        for (size_t c = 0; c < m_trail.size(); ++c) {
+            m_deposit[c] = std::min(m_trail[c] + std::min(m_deposit[c], kTrailMax), kTrailMax);
+        }
+        const int w = m_trailWidth;
+        const int h = m_trailHeight;
+        Parallel::forRange(h, threads, [&](int begin, int end) {
+            for (int y = begin; y < end; ++y) {
+                for (int x = 0; x < w; ++x) {
+                    uint32_t sum = 0;
+                    for (int dy = -1; dy <= 1; ++dy) {
+                        int yy = wrap(y + dy, h);
+                        for (int dx = -1; dx <= 1; ++dx) {
+                            sum += m_deposit[static_cast<size_t>(yy) * w + wrap(x + dx, w)];
+                        }
+                    }
+                    m_nextTrail[static_cast<size_t>(y) * w + x] = ((sum / 9u) * params.fade) >> 16;
+                }
+            }
+        });
+        m_trail.swap(m_nextTrail);
+        std::fill(m_deposit.begin(), m_deposit.end(), 0u);
+        ++m_step;
+    }
+
+    uint64_t Simulation::stateHash() const
+    {
+        return Deterministic::stateHash(m_agents.data(), m_agents.size(), m_trail.data(), m_trail.size());
+    }
+}
@@ -0,0 +1,175 @@
+#include "FftConvolution.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    constexpr double kPi = 3.14159265358979323846;
+
+    // Twiddle e^(-2 pi i k / n) per k < n/2, calcolati in double una volta per lunghezza
+    std::vector<Fft::Complex> makeTwiddles(int n)
+    {
+        std::vector<Fft::Complex> twiddles(n / 2);
+        for (int k = 0; k < n / 2; ++k) {
+            double angle = -2.0 * kPi * static_cast<double>(k) / static_cast<double>(n);
+            twiddles[k] = Fft::Complex(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+        }
+        return twiddles;
+    }
+
+    // Cooley-Tukey iterativo su dati contigui: permutazione bit-reversal, poi log2(n) stadi di butterfly
+    void transformContiguous(Fft::Complex* data, int n, const std::vector<Fft::Complex>& twiddles, bool inverse)
+    {
+        for (int i = 1, j = 0; i < n; ++i) {
+            int bit = n >> 1;
+            for (; j & bit; bit >>= 1) j ^= bit;
+            j ^= bit;
+            if (i < j) std::swap(data[i], data[j]);
+        }
+
+        for (int len = 2; len <= n; len <<= 1) {
+            int half = len >> 1;
+            int step = n / len;
+            for (int i = 0; i < n; i += len) {
+                for (int k = 0; k < half; ++k) {
+                    Fft::Complex w = twiddles[k * step];
+                    if (inverse) w = std::conj(w);
+                    Fft::Complex a = data[i + k];
+                    Fft::Complex b = data[i + k + half] * w;
+                    data[i + k] = a + b;
+                    data[i + k + half] = a - b;
+                }
+            }
+        }
+    }
+}
+
+namespace Fft
+{
+    int nextPowerOfTwo(int n)
+    {
+        int p = 1;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+    void paddedSize(int width, int height, int radius, int& paddedWidth, int& paddedHeight)
+    {
+        paddedWidth = nextPowerOfTwo(width + 2 * radius);
+        paddedHeight = nextPowerOfTwo(height + 2 * radius);
+    }
+
+    void transform2D(std::vector<Complex>& data, int width, int height, bool inverse, int threads)
+    {
+        const auto rowTwiddles = makeTwiddles(width);
+        const auto columnTwiddles = makeTwiddles(height);
+
+        Parallel::forRange(height, threads, [&](int begin, int end) {
+            for (int y = begin; y < end; ++y) {
+                transformContiguous(&data[static_cast<size_t>(y) * width], width, rowTwiddles, inverse);
+            }
+        });
+
+        // Colonne copiate in una linea contigua: lo stride di width complessi non sta in cache
+        Parallel::forRange(width, threads, [&](int begin, int end) {
+            std::vector<Complex> line(height);
+            for (int x = begin; x < end; ++x) {
+                for (int y = 0; y < height; ++y) line[y] = data[static_cast<size_t>(y) * width + x];
+                transformContiguous(line.data(), height, columnTwiddles, inverse);
+                for (int y = 0; y < height; ++y) data[static_cast<size_t>(y) * width + x] = line[y];
+            }
+        });
+    }
+
+    std::vector<Complex> kernelSpectrum(KernelType type, int radius, int paddedWidth, int paddedHeight)
+    {
+        std::vector<Complex> kernel(static_cast<size_t>(paddedWidth) * paddedHeight, Complex(0.0f, 0.0f));
+        const float r = static_cast<float>(std::max(radius, 1));
+        const float sigma = r / 3.0f;
+
+        double sum = 0.0;
+        for (int dy = -radius; dy <= radius; ++dy) {
+            for (int dx = -radius; dx <= radius; ++dx) {
+                float dist = std::sqrt(static_cast<float>(dx * dx + dy * dy));
+                float weight = 0.0f;
+                if (type == KernelType::Lenia) {
+                    float t = dist / r;
+                    if (t > 0.0f && t < 1.0f) weight = std::exp(4.0f - 1.0f / (t * (1.0f - t)));
+                } else if (dist <= r) {
+                    weight = std::exp(-(dist * dist) / (2.0f * sigma * sigma));
+                }
+                // Origine del kernel in (0,0), offset negativi avvolti in fondo al buffer
+                int x = (dx + paddedWidth) % paddedWidth;
+                int y = (dy + paddedHeight) % paddedHeight;
+                kernel[static_cast<size_t>(y) * paddedWidth + x] = Complex(weight, 0.0f);
+                sum += weight;
+            }
+        }
+
+        // Kernel senza supporto (es. anello Lenia con raggio 1): identita', non azzera il campo
+        if (sum <= 0.0) {
+            kernel[0] = Complex(1.0f, 0.0f);
+            sum = 1.0;
+        }
+        const float norm = static_cast<float>(1.0 / sum);
+        const float inverseScale = 1.0f / (static_cast<float>(paddedWidth) * static_cast<float>(paddedHeight));
+        for (auto& value : kernel) value *= norm * inverseScale;
+
+        transform2D(kernel, paddedWidth, paddedHeight, false);
+        return kernel;
+    }
+
+    void convolveTorus(std::vector<float>& rgba, int width, int height, int channels, int radius,
+                       const std::vector<Complex>& spectrum, int paddedWidth, int paddedHeight, int threads)
+    {
+        const size_t paddedCount = static_cast<size_t>(paddedWidth) * paddedHeight;
+        std::vector<Complex> buffer(paddedCount);
+
+        for (int channel = 0; channel < channels; channel += 2) {
+            const bool hasImag = (channel + 1) < channels;
+
+            // Pack: finestra (W + 2R) x (H + 2R) con bordo avvolto, zeri nel resto
+            Parallel::forRange(paddedHeight, threads, [&](int begin, int end) {
+                for (int y = begin; y < end; ++y) {
+                    Complex* row = &buffer[static_cast<size_t>(y) * paddedWidth];
+                    if (y >= height + 2 * radius) {
+                        std::fill(row, row + paddedWidth, Complex(0.0f, 0.0f));
+                        continue;
+                    }
+                    int sy = ((y - radius) % height + height) % height;
+                    for (int x = 0; x < paddedWidth; ++x) {
+                        if (x >= width + 2 * radius) {
+                            row[x] = Complex(0.0f, 0.0f);
+                            continue;
+                        }
+                        int sx = ((x - radius) % width + width) % width;
+                        const float* texel = &rgba[(static_cast<size_t>(sy) * width + sx) * 4];
+                        row[x] = Complex(texel[channel], hasImag ? texel[channel + 1] : 0.0f);
+                    }
+                }
+            });
+
+            transform2D(buffer, paddedWidth, paddedHeight, false, threads);
+            Parallel::forRange(static_cast<int>(paddedHeight), threads, [&](int begin, int end) {
+                for (size_t i = static_cast<size_t>(begin) * paddedWidth; i < static_cast<size_t>(end) * paddedWidth; ++i) {
+                    buffer[i] *= spectrum[i];
+                }
+            });
+            transform2D(buffer, paddedWidth, paddedHeight, true, threads);
+
+            // Unpack: la finestra centrale contiene la convoluzione circolare sul toro
+            Parallel::forRange(height, threads, [&](int begin, int end) {
+                for (int y = begin; y < end; ++y) {
+                    const Complex* row = &buffer[static_cast<size_t>(y + radius) * paddedWidth + radius];
+                    for (int x = 0; x < width; ++x) {
+                        float* texel = &rgba[(static_cast<size_t>(y) * width + x) * 4];
+                        texel[channel] = row[x].real();
+                        if (hasImag) texel[channel + 1] = row[x].imag();
+                    }
+                }
+            });
+        }
+    }
+}
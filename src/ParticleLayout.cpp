@@ -0,0 +1,352 @@
+#include "ParticleLayout.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    const char* kStandardRecord =
+        "struct ParticleRecord {\n"
+        PARTICLE_STANDARD_FIELDS(PARTICLE_GLSL_FIELD)
+        "};\n";
+
+    const char* kPackedRecord =
+        "struct ParticleRecord {\n"
+        PARTICLE_PACKED_FIELDS(PARTICLE_GLSL_FIELD)
+        "};\n";
+
+    const char* kSplitRecords =
+        "struct ParticlePosition {\n"
+        PARTICLE_SPLIT_POSITION_FIELDS(PARTICLE_GLSL_FIELD)
+        "};\n"
+        "struct ParticleMotion {\n"
+        PARTICLE_SPLIT_MOTION_FIELDS(PARTICLE_GLSL_FIELD)
+        "};\n"
+        "struct ParticleAttributes {\n"
+        PARTICLE_SPLIT_ATTRIBUTE_FIELDS(PARTICLE_GLSL_FIELD)
+        "};\n";
+
+    // Struct di lavoro degli shader, indipendente dal layout di memoria
+    const char* kLogicalParticle =
+        "struct Particle {\n"
+        "    vec2 position;\n"
+        "    vec2 dir;\n"
+        "    float speed;\n"
+        "    uint species;\n"
+        "    uint flags;\n"
+        "    uint rng;\n"       // stato PCG, avanzato dall'update
+        "};\n";
+
+    // Particelle attive: dall'uniform, oppure dal record corrente del conteggio in GPU (emettitori)
+    const char* kParticleCount =
+        "struct ParticleCountRecord {\n"
+        "    uint dispatch256[3];\n"
+        "    uint dispatch128[3];\n"
+        "    uint liveCount;\n"
+        "    uint survivors;\n"
+        "};\n"
+        "layout(location = PARTICLE_COUNT_LOCATION) uniform int uParticleCount;\n"
+        "layout(std430, binding = PARTICLE_COUNT_BINDING) readonly buffer ParticleCountBuffer {\n"
+        "    ParticleCountRecord current;\n"
+        "} particleCountState;\n"
+        "uint particleCount() {\n"
+        "    return uParticleCount >= 0 ? uint(uParticleCount) : particleCountState.current.liveCount;\n"
+        "}\n";
+
+    const char* kStandardCodec =
+        "Particle loadParticle(uint i) {\n"
+        "    ParticleRecord r = inParticles.particles[i];\n"
+        "    return Particle(r.position, r.direction, r.speed, r.species, r.flags, r.rngState);\n"
+        "}\n"
+        "vec2 loadParticlePosition(uint i) { return inParticles.particles[i].position; }\n"
+        "vec2 loadParticleDirection(uint i) { return inParticles.particles[i].direction; }\n"
+        "float loadParticleSpeed(uint i) { return inParticles.particles[i].speed; }\n"
+        "uint loadParticleSpecies(uint i) { return inParticles.particles[i].species; }\n"
+        "void storeParticle(uint i, Particle p) {\n"
+        "    outParticles.particles[i] = ParticleRecord(p.position, p.dir, p.speed, p.species, p.flags, p.rng);\n"
+        "}\n";
+
+    // Direzione in snorm16 (passo ~3e-5), rinormalizzata in lettura per non accumulare deriva.
+    // speedSpeciesFlags: bit 0-15 velocita' half, 16-23 specie, 24-31 flag.
+    // Lo stato PCG non e' salvato: ogni passo parte da indice e uParticleRngStep (hash di seme e passo)
+    const char* kPackedCodec =
+        "layout(location = PARTICLE_RNG_STEP_LOCATION) uniform uint uParticleRngStep;\n"
+        "Particle loadParticle(uint i) {\n"
+        "    ParticleRecord r = inParticles.particles[i];\n"
+        "    vec2 dir = normalize(unpackSnorm2x16(r.direction));\n"
+        "    float speed = unpackHalf2x16(r.speedSpeciesFlags).x;\n"
+        "    uint rng = (i * 2654435761u) ^ uParticleRngStep;\n"
+        "    return Particle(r.position, dir, speed, (r.speedSpeciesFlags >> 16) & 0xFFu, r.speedSpeciesFlags >> 24, rng);\n"
+        "}\n"
+        "vec2 loadParticlePosition(uint i) { return inParticles.particles[i].position; }\n"
+        "vec2 loadParticleDirection(uint i) { return normalize(unpackSnorm2x16(inParticles.particles[i].direction)); }\n"
+        "float loadParticleSpeed(uint i) { return unpackHalf2x16(inParticles.particles[i].speedSpeciesFlags).x; }\n"
+        "uint loadParticleSpecies(uint i) { return (inParticles.particles[i].speedSpeciesFlags >> 16) & 0xFFu; }\n"
+        "void storeParticle(uint i, Particle p) {\n"
+        "    uint bits = (packHalf2x16(vec2(p.speed, 0.0)) & 0xFFFFu) | (min(p.species, 0xFFu) << 16) | ((p.flags & 0xFFu) << 24);\n"
+        "    outParticles.particles[i] = ParticleRecord(p.position, packSnorm2x16(p.dir), bits);\n"
+        "}\n";
+
+    const char* kSplitCodec =
+        "Particle loadParticle(uint i) {\n"
+        "    ParticleMotion m = inMotion.motion[i];\n"
+        "    ParticleAttributes a = inAttributes.attributes[i];\n"
+        "    return Particle(inPositions.positions[i].position, m.direction, m.speed, a.species, a.flags, m.rngState);\n"
+        "}\n"
+        "vec2 loadParticlePosition(uint i) { return inPositions.positions[i].position; }\n"
+        "vec2 loadParticleDirection(uint i) { return inMotion.motion[i].direction; }\n"
+        "float loadParticleSpeed(uint i) { return inMotion.motion[i].speed; }\n"
+        "uint loadParticleSpecies(uint i) { return inAttributes.attributes[i].species; }\n"
+        "void storeParticle(uint i, Particle p) {\n"
+        "    outPositions.positions[i] = ParticlePosition(p.position);\n"
+        "    outMotion.motion[i] = ParticleMotion(p.dir, p.speed, p.rng);\n"
+        "    outAttributes.attributes[i] = ParticleAttributes(p.species, p.flags);\n"
+        "}\n";
+
+    // Coppia di SSBO (ingresso readonly, uscita writeonly) per uno stream: InName / OutName, istanze inName / outName
+    std::string streamBuffers(const Particles::Stream& stream, const std::string& name,
+                              const std::string& record, const std::string& member)
+    {
+        std::string source;
+        source += "layout(std430, binding = " + std::to_string(stream.inBinding) + ") readonly buffer In" + name
+                + " {\n    " + record + " " + member + "[];\n} in" + name + ";\n";
+        source += "layout(std430, binding = " + std::to_string(stream.outBinding) + ") writeonly buffer Out" + name
+                + " {\n    " + record + " " + member + "[];\n} out" + name + ";\n";
+        return source;
+    }
+
+    // float -> half IEEE 754 con arrotondamento al pari (stessa semantica di packHalf2x16)
+    uint16_t floatToHalf(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000u;
+        int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFFu) - 127 + 15;
+        uint32_t mantissa = bits & 0x7FFFFFu;
+
+        if (((bits >> 23) & 0xFFu) == 0xFFu) {   // Inf / NaN
+            return static_cast<uint16_t>(sign | 0x7C00u | (mantissa ? 0x200u : 0u));
+        }
+        if (exponent >= 31) return static_cast<uint16_t>(sign | 0x7C00u);
+        if (exponent <= 0) {
+            if (exponent < -10) return static_cast<uint16_t>(sign);
+            mantissa |= 0x800000u;
+            uint32_t shift = static_cast<uint32_t>(14 - exponent);
+            uint32_t half = mantissa >> shift;
+            uint32_t rest = mantissa & ((1u << shift) - 1u);
+            uint32_t midpoint = 1u << (shift - 1);
+            if (rest > midpoint || (rest == midpoint && (half & 1u))) ++half;
+            return static_cast<uint16_t>(sign | half);
+        }
+
+        uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+        uint32_t rest = mantissa & 0x1FFFu;
+        if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) ++half;   // il riporto sale nell'esponente
+        return static_cast<uint16_t>(half);
+    }
+
+    float halfToFloat(uint16_t value)
+    {
+        uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+        uint32_t exponent = (value >> 10) & 0x1Fu;
+        uint32_t mantissa = value & 0x3FFu;
+        uint32_t bits;
+
+        if (exponent == 0) {
+            if (mantissa == 0) {
+                bits = sign;
+            } else {
+                float f = std::ldexp(static_cast<float>(mantissa), -24);
+                return (value & 0x8000u) ? -f : f;
+            }
+        } else if (exponent == 31) {
+            bits = sign | 0x7F800000u | (mantissa << 13);
+        } else {
+            bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+        }
+        float result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    // Stessa semantica di packSnorm2x16 / unpackSnorm2x16 per una componente
+    uint32_t floatToSnorm16(float value)
+    {
+        float scaled = std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f);
+        return static_cast<uint32_t>(static_cast<uint16_t>(static_cast<int16_t>(scaled)));
+    }
+
+    float snorm16ToFloat(uint32_t bits)
+    {
+        return std::max(static_cast<float>(static_cast<int16_t>(bits & 0xFFFFu)) / 32767.0f, -1.0f);
+    }
+
+    GpuParticlePacked packParticle(const GpuParticle& p)
+    {
+        uint32_t species = std::min(p.species, 0xFFu);
+
+        GpuParticlePacked packed;
+        packed.position[0] = p.position[0];
+        packed.position[1] = p.position[1];
+        packed.direction = floatToSnorm16(p.direction[0]) | (floatToSnorm16(p.direction[1]) << 16);
+        packed.speedSpeciesFlags = static_cast<uint32_t>(floatToHalf(p.speed)) | (species << 16) | ((p.flags & 0xFFu) << 24);
+        return packed;
+    }
+
+    GpuParticle unpackParticle(const GpuParticlePacked& packed)
+    {
+        GpuParticle p{};
+        p.position[0] = packed.position[0];
+        p.position[1] = packed.position[1];
+        float dx = snorm16ToFloat(packed.direction);
+        float dy = snorm16ToFloat(packed.direction >> 16);
+        float length = std::sqrt(dx * dx + dy * dy);
+        p.direction[0] = (length > 0.0f) ? dx / length : 1.0f;
+        p.direction[1] = (length > 0.0f) ? dy / length : 0.0f;
+        p.speed = halfToFloat(static_cast<uint16_t>(packed.speedSpeciesFlags & 0xFFFFu));
+        p.species = (packed.speedSpeciesFlags >> 16) & 0xFFu;
+        p.flags = packed.speedSpeciesFlags >> 24;
+        return p;
+    }
+}
+
+namespace Particles
+{
+    int streamCount(ParticleLayout layout)
+    {
+        return (layout == ParticleLayout::Split) ? 3 : 1;
+    }
+
+    Stream stream(ParticleLayout layout, int index)
+    {
+        switch (layout) {
+        case ParticleLayout::Packed:
+            return { sizeof(GpuParticlePacked), 0, 1 };
+        case ParticleLayout::Split: {
+            static const Stream kSplitStreams[3] = {
+                { sizeof(GpuParticlePosition),   0,  1 },
+                { sizeof(GpuParticleMotion),     12, 14 },
+                { sizeof(GpuParticleAttributes), 13, 15 }
+            };
+            return kSplitStreams[std::clamp(index, 0, 2)];
+        }
+        default:
+            return { sizeof(GpuParticle), 0, 1 };
+        }
+    }
+
+    int storageBlocks(ParticleLayout layout)
+    {
+        return 2 * streamCount(layout) + 1;
+    }
+
+    size_t stride(ParticleLayout layout)
+    {
+        size_t total = 0;
+        for (int i = 0; i < streamCount(layout); ++i) total += stream(layout, i).stride;
+        return total;
+    }
+
+    const char* label(ParticleLayout layout)
+    {
+        switch (layout) {
+        case ParticleLayout::Packed: return "Packed (16 B)";
+        case ParticleLayout::Split:  return "Split streams (8+16+8 B)";
+        default:                     return "Standard (32 B)";
+        }
+    }
+
+    std::string glslDefinitions(ParticleLayout layout)
+    {
+        std::string source = "#define PARTICLE_COUNT_BINDING " + std::to_string(kCountBinding) + "\n"
+                             "#define PARTICLE_COUNT_LOCATION " + std::to_string(kCountLocation) + "\n"
+                             "#define PARTICLE_RNG_STEP_LOCATION " + std::to_string(kRngStepLocation) + "\n"
+                             "#define PARTICLE_SPECIES_BLOCK " + std::to_string(kSpeciesBlock) + "u\n";
+        source += kParticleCount;
+        if (layout == ParticleLayout::Split) {
+            source += "#define PARTICLE_LAYOUT_SPLIT\n";
+            source += kSplitRecords;
+            source += kLogicalParticle;
+            source += streamBuffers(stream(layout, 0), "Positions", "ParticlePosition", "positions");
+            source += streamBuffers(stream(layout, 1), "Motion", "ParticleMotion", "motion");
+            source += streamBuffers(stream(layout, 2), "Attributes", "ParticleAttributes", "attributes");
+            source += kSplitCodec;
+            return source;
+        }
+
+        const bool packed = (layout == ParticleLayout::Packed);
+        source += packed ? "#define PARTICLE_LAYOUT_PACKED\n" : "#define PARTICLE_LAYOUT_STANDARD\n";
+        source += packed ? kPackedRecord : kStandardRecord;
+        source += kLogicalParticle;
+        source += streamBuffers(stream(layout, 0), "Particles", "ParticleRecord", "particles");
+        source += packed ? kPackedCodec : kStandardCodec;
+        return source;
+    }
+
+    void encode(const GpuParticle* particles, size_t count, ParticleLayout layout, int streamIndex, std::vector<unsigned char>& out)
+    {
+        out.resize(count * stream(layout, streamIndex).stride);
+        if (layout == ParticleLayout::Packed) {
+            auto* dst = reinterpret_cast<GpuParticlePacked*>(out.data());
+            for (size_t i = 0; i < count; ++i) dst[i] = packParticle(particles[i]);
+        } else if (layout == ParticleLayout::Split) {
+            if (streamIndex == 0) {
+                auto* dst = reinterpret_cast<GpuParticlePosition*>(out.data());
+                for (size_t i = 0; i < count; ++i) {
+                    dst[i].position[0] = particles[i].position[0];
+                    dst[i].position[1] = particles[i].position[1];
+                }
+            } else if (streamIndex == 1) {
+                auto* dst = reinterpret_cast<GpuParticleMotion*>(out.data());
+                for (size_t i = 0; i < count; ++i) {
+                    dst[i].direction[0] = particles[i].direction[0];
+                    dst[i].direction[1] = particles[i].direction[1];
+                    dst[i].speed = particles[i].speed;
+                    dst[i].rngState = particles[i].rngState;
+                }
+            } else {
+                auto* dst = reinterpret_cast<GpuParticleAttributes*>(out.data());
+                for (size_t i = 0; i < count; ++i) {
+                    dst[i].species = particles[i].species;
+                    dst[i].flags = particles[i].flags;
+                }
+            }
+        } else {
+            std::memcpy(out.data(), particles, out.size());
+        }
+    }
+
+    void decode(const void* data, size_t count, ParticleLayout layout, int streamIndex, std::vector<GpuParticle>& out)
+    {
+        out.resize(count);
+        if (layout == ParticleLayout::Packed) {
+            const auto* src = static_cast<const GpuParticlePacked*>(data);
+            for (size_t i = 0; i < count; ++i) out[i] = unpackParticle(src[i]);
+        } else if (layout == ParticleLayout::Split) {
+            if (streamIndex == 0) {
+                const auto* src = static_cast<const GpuParticlePosition*>(data);
+                for (size_t i = 0; i < count; ++i) {
+                    out[i].position[0] = src[i].position[0];
+                    out[i].position[1] = src[i].position[1];
+                }
+            } else if (streamIndex == 1) {
+                const auto* src = static_cast<const GpuParticleMotion*>(data);
+                for (size_t i = 0; i < count; ++i) {
+                    out[i].direction[0] = src[i].direction[0];
+                    out[i].direction[1] = src[i].direction[1];
+                    out[i].speed = src[i].speed;
+                    out[i].rngState = src[i].rngState;
+                }
+            } else {
+                const auto* src = static_cast<const GpuParticleAttributes*>(data);
+                for (size_t i = 0; i < count; ++i) {
+                    out[i].species = src[i].species;
+                    out[i].flags = src[i].flags;
+                }
+            }
+        } else {
+            std::memcpy(out.data(), data, count * sizeof(GpuParticle));
+        }
+    }
+}
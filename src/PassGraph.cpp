@@ -0,0 +1,180 @@
+#include "PassGraph.h"
+
+#include <cstddef>
+
+namespace
+{
+    // Bit che rende visibile una scrittura di shader all'accesso indicato
+    GLbitfield barrierBit(const PassGraph::Use& use)
+    {
+        switch (use.access) {
+        case PassGraph::Access::StorageRead:
+        case PassGraph::Access::StorageWrite: return GL_SHADER_STORAGE_BARRIER_BIT;
+        case PassGraph::Access::ImageRead:
+        case PassGraph::Access::ImageWrite:   return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+        case PassGraph::Access::Sampled:      return GL_TEXTURE_FETCH_BARRIER_BIT;
+        case PassGraph::Access::Indirect:     return GL_COMMAND_BARRIER_BIT;
+        case PassGraph::Access::Transfer:     return use.texture ? GL_TEXTURE_UPDATE_BARRIER_BIT : GL_BUFFER_UPDATE_BARRIER_BIT;
+        }
+        return GL_ALL_BARRIER_BITS;
+    }
+
+    bool writesFromShader(PassGraph::Access access)
+    {
+        // Le scritture via comandi GL (Transfer) sono gia' ordinate dal driver rispetto ai dispatch successivi
+        return access == PassGraph::Access::StorageWrite || access == PassGraph::Access::ImageWrite;
+    }
+
+    bool overlaps(int levelA, int levelB)
+    {
+        return levelA < 0 || levelB < 0 || levelA == levelB;
+    }
+
+    // Tutti gli usi possibili fuori dal grafo, per tipo di risorsa
+    constexpr GLbitfield kTextureBits = GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT |
+                                        GL_TEXTURE_UPDATE_BARRIER_BIT;
+    constexpr GLbitfield kBufferBits = GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT |
+                                       GL_COMMAND_BARRIER_BIT;
+}
+
+PassGraph::PassGraph()
+    : m_set(0)
+    , m_collectedSet(0)
+    , m_setPending{ false, false }
+    , m_lastQuery{ 0, 0 }
+    , m_barrierCount(0)
+    , m_lastBarrierCount(0)
+{
+}
+
+PassGraph::~PassGraph()
+{
+    // Le query appartengono al contesto: release() le cancella finche' e' corrente
+}
+
+void PassGraph::initialize(int passCount)
+{
+    release();
+    m_passes.resize(static_cast<size_t>(passCount));
+    for (PassSlot& slot : m_passes) {
+        glGenQueries(2, slot.queries[0]);
+        glGenQueries(2, slot.queries[1]);
+    }
+}
+
+void PassGraph::release()
+{
+    for (PassSlot& slot : m_passes) {
+        glDeleteQueries(2, slot.queries[0]);
+        glDeleteQueries(2, slot.queries[1]);
+    }
+    m_passes.clear();
+    m_pending.clear();
+    discardTimings();
+}
+
+bool PassGraph::beginFrame()
+{
+    // Il set corrente e' stato registrato due passi fa
+    const int set = m_set;
+    bool collected = false;
+    if (m_setPending[set]) {
+        GLint available = 0;
+        glGetQueryObjectiv(m_lastQuery[set], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            for (PassSlot& slot : m_passes) {
+                slot.ran = slot.issued[set];
+                slot.ms = 0.0f;
+                if (!slot.ran) continue;
+                GLuint64 times[2] = { 0, 0 };
+                glGetQueryObjectui64v(slot.queries[set][0], GL_QUERY_RESULT, &times[0]);
+                glGetQueryObjectui64v(slot.queries[set][1], GL_QUERY_RESULT, &times[1]);
+                slot.ms = static_cast<float>((times[1] - times[0]) / 1000000.0);
+            }
+            m_collectedSet = set;
+            collected = true;
+        }
+        // Non ancora pronto: il set viene comunque riscritto, i suoi tempi vanno persi
+        m_setPending[set] = false;
+    }
+    for (PassSlot& slot : m_passes) slot.issued[set] = false;
+    m_lastQuery[set] = 0;
+    m_barrierCount = 0;
+    return collected;
+}
+
+void PassGraph::endFrame()
+{
+    flush();
+    m_lastBarrierCount = m_barrierCount;
+    m_setPending[m_set] = (m_lastQuery[m_set] != 0);
+    m_set = 1 - m_set;
+}
+
+void PassGraph::beginPass(int pass, const char* name)
+{
+    PassSlot& slot = m_passes[pass];
+    slot.name = name;
+    glQueryCounter(slot.queries[m_set][0], GL_TIMESTAMP);
+}
+
+void PassGraph::endPass(int pass)
+{
+    PassSlot& slot = m_passes[pass];
+    glQueryCounter(slot.queries[m_set][1], GL_TIMESTAMP);
+    slot.issued[m_set] = true;
+    m_lastQuery[m_set] = slot.queries[m_set][1];
+}
+
+void PassGraph::access(std::initializer_list<Use> uses)
+{
+    GLbitfield bits = 0;
+    for (const Use& use : uses) {
+        const GLbitfield needed = barrierBit(use);
+        for (const PendingWrite& write : m_pending) {
+            if (write.object == use.object && write.texture == use.texture && overlaps(write.level, use.level) &&
+                !(write.visible & needed)) {
+                bits |= needed;
+            }
+        }
+    }
+    barrier(bits);
+
+    for (const Use& use : uses) {
+        if (!writesFromShader(use.access)) continue;
+        bool found = false;
+        for (PendingWrite& write : m_pending) {
+            if (write.object == use.object && write.texture == use.texture && write.level == use.level) {
+                write.visible = 0;
+                found = true;
+            }
+        }
+        if (!found) m_pending.push_back({ use.object, use.level, use.texture, 0 });
+    }
+}
+
+void PassGraph::flush()
+{
+    GLbitfield bits = 0;
+    for (const PendingWrite& write : m_pending) {
+        bits |= (write.texture ? kTextureBits : kBufferBits) & ~write.visible;
+    }
+    barrier(bits);
+    m_pending.clear();
+}
+
+void PassGraph::discardTimings()
+{
+    m_setPending[0] = m_setPending[1] = false;
+    m_lastQuery[0] = m_lastQuery[1] = 0;
+    for (PassSlot& slot : m_passes) slot.issued[0] = slot.issued[1] = false;
+}
+
+void PassGraph::barrier(GLbitfield bits)
+{
+    if (!bits) return;
+    glMemoryBarrier(bits);
+    // Una barriera vale per tutte le scritture precedenti, non solo per quelle che l'hanno richiesta
+    for (PendingWrite& write : m_pending) write.visible |= bits;
+    m_barrierCount++;
+}
@@ -0,0 +1,268 @@
+#include "ProgramCache.h"
+#include "DeterministicSimulation.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    // GL_KHR/ARB_parallel_shader_compile (stesso enum, non presente nel loader glad del core profile)
+    constexpr GLenum kCompletionStatus = 0x91B1;
+    constexpr uint32_t kFileMagic = 0x31424350;   // "PCB1"
+
+    std::string g_directory;
+    bool g_enabled = false;
+    bool g_probed = false;
+    bool g_parallel = false;
+    ProgramCache::Stats g_stats;
+
+    using Clock = std::chrono::steady_clock;
+
+    double elapsedMs(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    void probeContext()
+    {
+        if (g_probed) return;
+        g_probed = true;
+        GLint extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (GLint i = 0; i < extensionCount; ++i) {
+            const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+            if (!name) continue;
+            if (std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0 ||
+                std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0) g_parallel = true;
+        }
+    }
+
+    // Un binario vale solo per lo stesso driver: vendor, renderer e versione entrano nella chiave
+    const std::string& driverSignature()
+    {
+        static const std::string signature = [] {
+            auto text = [](GLenum name) {
+                const char* value = reinterpret_cast<const char*>(glGetString(name));
+                return std::string(value ? value : "");
+            };
+            return text(GL_VENDOR) + "\n" + text(GL_RENDERER) + "\n" + text(GL_VERSION) + "\n";
+        }();
+        return signature;
+    }
+
+    std::string hashKey(const std::string* sources, int count)
+    {
+        const std::string& driver = driverSignature();
+        uint64_t hash = Deterministic::fnv1a(driver.data(), driver.size());
+        for (int i = 0; i < count; ++i) {
+            const char separator = '\0';
+            hash = Deterministic::fnv1a(sources[i].data(), sources[i].size(), hash);
+            hash = Deterministic::fnv1a(&separator, 1, hash);
+        }
+        char text[17];
+        std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+        return text;
+    }
+
+    std::string binaryPath(const std::string& key)
+    {
+        return g_directory + "/" + key + ".bin";
+    }
+
+    // File: magic, formato binario del driver, lunghezza, byte del programma
+    GLuint loadBinary(const std::string& key)
+    {
+        std::ifstream file(binaryPath(key), std::ios::binary);
+        if (!file.is_open()) return 0;
+        uint32_t header[3] = {0, 0, 0};
+        file.read(reinterpret_cast<char*>(header), sizeof(header));
+        if (!file || header[0] != kFileMagic || header[2] == 0) return 0;
+        std::vector<char> data(header[2]);
+        file.read(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!file) return 0;
+        file.close();
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, static_cast<GLenum>(header[1]), data.data(), static_cast<GLsizei>(data.size()));
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            // Driver aggiornato senza cambiare la versione riportata, o file corrotto: si ricompila
+            glDeleteProgram(program);
+            std::error_code ec;
+            std::filesystem::remove(binaryPath(key), ec);
+            g_stats.rejected++;
+            return 0;
+        }
+        return program;
+    }
+
+    void storeBinary(GLuint program, const std::string& key)
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+        std::vector<char> data(static_cast<size_t>(length));
+        GLsizei written = 0;
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &written, &format, data.data());
+        if (written <= 0) return;
+
+        // File temporaneo + rename: un'altra istanza non legge mai un binario a meta'
+        const std::string path = binaryPath(key);
+        const std::string temporary = path + ".tmp";
+        std::error_code ec;
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            const uint32_t header[3] = { kFileMagic, static_cast<uint32_t>(format), static_cast<uint32_t>(written) };
+            file.write(reinterpret_cast<const char*>(header), sizeof(header));
+            file.write(data.data(), written);
+            if (!file) {
+                file.close();
+                std::filesystem::remove(temporary, ec);
+                return;
+            }
+        }
+        std::filesystem::rename(temporary, path, ec);
+        if (ec) std::filesystem::remove(temporary, ec);
+    }
+
+    ProgramCache::Pending start(const GLenum* types, const std::string* sources, int count, const std::string& label)
+    {
+        const auto startTime = Clock::now();
+        probeContext();
+
+        ProgramCache::Pending pending;
+        pending.label = label;
+        if (g_enabled) {
+            pending.key = hashKey(sources, count);
+            pending.program = loadBinary(pending.key);
+            pending.cached = (pending.program != 0);
+        }
+        if (!pending.cached) {
+            pending.program = glCreateProgram();
+            if (g_enabled) glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            for (int i = 0; i < count; ++i) {
+                GLuint shader = glCreateShader(types[i]);
+                const char* src = sources[i].c_str();
+                glShaderSource(shader, 1, &src, nullptr);
+                glCompileShader(shader);
+                glAttachShader(pending.program, shader);
+                glDeleteShader(shader);   // resta attaccato (e interrogabile) fino alla cancellazione del programma
+            }
+            glLinkProgram(pending.program);
+        }
+        g_stats.ms += elapsedMs(startTime);
+        return pending;
+    }
+
+    const char* shaderTypeName(GLint type)
+    {
+        switch (type) {
+        case GL_COMPUTE_SHADER:  return "COMPUTE";
+        case GL_VERTEX_SHADER:   return "VERTEX";
+        case GL_FRAGMENT_SHADER: return "FRAGMENT";
+        default:                 return "UNKNOWN";
+        }
+    }
+}
+
+namespace ProgramCache
+{
+    void setDirectory(const std::string& directory)
+    {
+        g_directory = directory;
+        g_enabled = false;
+        if (directory.empty()) return;
+
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        g_enabled = (formats > 0) && !ec;
+    }
+
+    bool isEnabled()
+    {
+        return g_enabled;
+    }
+
+    bool hasParallelCompile()
+    {
+        probeContext();
+        return g_parallel;
+    }
+
+    Pending startCompute(const std::string& source, const std::string& label)
+    {
+        const GLenum type = GL_COMPUTE_SHADER;
+        return start(&type, &source, 1, label);
+    }
+
+    Pending startGraphics(const std::string& vertexSource, const std::string& fragmentSource, const std::string& label)
+    {
+        const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+        const std::string sources[2] = { vertexSource, fragmentSource };
+        return start(types, sources, 2, label);
+    }
+
+    bool isComplete(const Pending& pending)
+    {
+        if (pending.cached) return true;
+        if (!hasParallelCompile()) return false;
+        GLint done = 0;
+        glGetProgramiv(pending.program, kCompletionStatus, &done);
+        return done != 0;
+    }
+
+    GLuint finish(Pending& pending)
+    {
+        if (pending.cached) {
+            g_stats.loaded++;
+            return pending.program;
+        }
+
+        const auto startTime = Clock::now();
+        GLint success = 0;
+        glGetProgramiv(pending.program, GL_LINK_STATUS, &success);
+        if (!success) {
+            g_stats.ms += elapsedMs(startTime);
+            // Prima gli errori di compilazione degli shader attaccati, poi quello di link
+            GLuint shaders[2] = {0, 0};
+            GLsizei shaderCount = 0;
+            glGetAttachedShaders(pending.program, 2, &shaderCount, shaders);
+            char infoLog[512];
+            for (GLsizei i = 0; i < shaderCount; ++i) {
+                GLint compiled = 0;
+                glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &compiled);
+                if (compiled) continue;
+                GLint type = 0;
+                glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type);
+                glGetShaderInfoLog(shaders[i], 512, nullptr, infoLog);
+                throw std::runtime_error(pending.label + " shader compile error (" + shaderTypeName(type) + "):\n" + infoLog);
+            }
+            glGetProgramInfoLog(pending.program, 512, nullptr, infoLog);
+            throw std::runtime_error(pending.label + " shader link error:\n" + std::string(infoLog));
+        }
+        if (g_enabled) storeBinary(pending.program, pending.key);
+        g_stats.compiled++;
+        g_stats.ms += elapsedMs(startTime);
+        return pending.program;
+    }
+
+    const Stats& stats()
+    {
+        return g_stats;
+    }
+
+    void resetStats()
+    {
+        g_stats = Stats();
+    }
+}
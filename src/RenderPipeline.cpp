@@ -1,6 +1,10 @@
 #include "RenderPipeline.h"
 #include <stdexcept>
 #include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
 
 RenderPipeline::RenderPipeline(int width, int height)
     : m_width(width)
@@ -9,7 +13,6 @@ RenderPipeline::RenderPipeline(int width, int height)
     , m_outputHeight(height)
     , m_quadVAO(0)
     , m_quadVBO(0)
-    , m_final_uTextureLoc(-1)
 {
 }
 
@@ -18,6 +21,8 @@ RenderPipeline::~RenderPipeline()
     // Non abbiamo più ping/pong FBO/texture
     glDeleteVertexArrays(1, &m_quadVAO);
     glDeleteBuffers(1, &m_quadVBO);
+    glDeleteTextures(1, &m_toneLutTexture);
+    glDeleteBuffers(1, &m_renderParamsUBO);
 }
 
 void RenderPipeline::initialize()
@@ -25,10 +30,54 @@ void RenderPipeline::initialize()
 
     // Final (compositing)
     m_finalShader.load("shaders/final.vert", "shaders/final.frag");
-    // Pre-cachiamo gli uniform
-    m_final_uTextureLoc     = glGetUniformLocation(m_finalShader.getID(), "uTexture");
+    // Parametri del pass finale: un uniform block agganciato una volta, riempito al primo frame
+    glGenBuffers(1, &m_renderParamsUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_renderParamsUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(RenderParams), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, kRenderParamsBinding, m_renderParamsUBO);
+    m_renderParamsValid = false;
     // Creiamo solo il quad fullscreen
     setupQuadVAO();
+
+    // LUT di tone mapping (riempita al primo frame)
+    glGenTextures(1, &m_toneLutTexture);
+    glBindTexture(GL_TEXTURE_1D, m_toneLutTexture);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RG32F, kToneLutSize, 0, GL_RG, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+void RenderPipeline::updateToneLut(float range)
+{
+    const float key[5] = { m_toneExposure, m_autoDimThreshold, m_autoDimStrength, m_autoDimGlobal, range };
+    if (std::equal(key, key + 5, m_toneLutKey)) return;
+    std::copy(key, key + 5, m_toneLutKey);
+    m_toneLutRange = range;
+
+    // Stesse formule che prima giravano nel blur ad ogni step, ora campionate una volta
+    const float k = std::max(m_toneExposure, 0.001f);
+    const float invLogK = 1.0f / std::log(1.0f + k);
+    std::vector<float> lut(kToneLutSize * 2);
+    for (int i = 0; i < kToneLutSize; ++i)
+    {
+        float x = range * static_cast<float>(i) / static_cast<float>(kToneLutSize - 1);
+
+        // R: log-like tone mapping per canale
+        lut[i * 2 + 0] = std::log(1.0f + x * k) * invLogK;
+
+        // G: dimming in funzione della luminanza tonemappata (stesso dominio [0, range])
+        float over = std::max(0.0f, x - m_autoDimThreshold) / std::max(1.0f - m_autoDimThreshold, 1e-4f);
+        float dim = 1.0f - m_autoDimStrength * over;
+        float globalDim = 1.0f / (1.0f + m_autoDimGlobal * x);
+        lut[i * 2 + 1] = dim * globalDim;
+    }
+
+    glBindTexture(GL_TEXTURE_1D, m_toneLutTexture);
+    glTexSubImage1D(GL_TEXTURE_1D, 0, 0, kToneLutSize, GL_RG, GL_FLOAT, lut.data());
+    glBindTexture(GL_TEXTURE_1D, 0);
 }
 
 void RenderPipeline::render(const SimulationGPU& simulation, int windowWidth, int windowHeight)
@@ -59,23 +108,53 @@ void RenderPipeline::finalPass(const SimulationGPU& simulation)
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, finalTex);
 
-    if (m_final_uTextureLoc >= 0)
-        glUniform1i(m_final_uTextureLoc, 0);
+    // Tone mapping: i formati float superano 1.0, quindi la LUT copre un range piu' ampio
+    const auto& formatInfo = SimulationGPU::getTextureFormatInfo(simulation.getTextureFormat());
+    updateToneLut(formatInfo.isFloat ? 16.0f : 1.0f);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_1D, m_toneLutTexture);
+    glActiveTexture(GL_TEXTURE0);
 
-    // Pass PostFX uniforms
-    glUniform1i(glGetUniformLocation(m_finalShader.getID(), "uColorMode"), m_colorMode);
-    glUniform1f(glGetUniformLocation(m_finalShader.getID(), "uTime"), m_time);
-    glUniform3fv(glGetUniformLocation(m_finalShader.getID(), "uColor1"), 1, m_color1);
-    glUniform3fv(glGetUniformLocation(m_finalShader.getID(), "uColor2"), 1, m_color2);
-    glUniform1f(glGetUniformLocation(m_finalShader.getID(), "uNeonSpeed"), m_neonSpeed);
-    glUniform1f(glGetUniformLocation(m_finalShader.getID(), "uNeonRange"), m_neonRange);
-    glUniform3fv(glGetUniformLocation(m_finalShader.getID(), "uBackgroundColor"), 1, m_backgroundColor);
+    RenderParams params = {};
+    std::copy(m_color1, m_color1 + 3, params.color1);
+    std::copy(m_color2, m_color2 + 3, params.color2);
+    std::copy(m_backgroundColor, m_backgroundColor + 3, params.backgroundColor);
+    // Il tempo anima solo le palette: con l'originale il blocco resta uguale e non si ricarica
+    params.time = (m_colorMode == 0) ? 0.0f : m_time;
+    params.neonSpeed = m_neonSpeed;
+    params.neonRange = m_neonRange;
+    // Coordinata LUT = x * scale + bias (centri dei texel agli estremi)
+    params.toneLutScaleBias[0] = (static_cast<float>(kToneLutSize - 1) / static_cast<float>(kToneLutSize)) / m_toneLutRange;
+    params.toneLutScaleBias[1] = 0.5f / static_cast<float>(kToneLutSize);
+    params.colorMode = m_colorMode;
+    params.trailChannels = formatInfo.channels;
+
+    // Campo di reazione (unita' 2), solo se attivo nella simulazione
+    params.reactionOverlay = simulation.isReactionEnabled() ? m_reactionOverlay : 0.0f;
+    if (params.reactionOverlay > 0.0f) {
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, simulation.getReactionTexture());
+        glActiveTexture(GL_TEXTURE0);
+    }
+    uploadRenderParams(params);
 
     renderQuad();
 
     if (wasBlendEnabled) glEnable(GL_BLEND);
 }
 
+void RenderPipeline::uploadRenderParams(const RenderParams& params)
+{
+    static_assert(sizeof(RenderParams) % 16 == 0, "blocco std140");
+    if (m_renderParamsValid && std::memcmp(&params, &m_renderParams, sizeof(params)) == 0) return;
+
+    m_renderParams = params;
+    glBindBuffer(GL_UNIFORM_BUFFER, m_renderParamsUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(m_renderParams), &m_renderParams);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    m_renderParamsValid = true;
+}
+
 void RenderPipeline::setupQuadVAO()
 {
     float quadVertices[] = {
@@ -4,10 +4,14 @@
 #include <sstream>
 #include <stdexcept>
 #include <vector>
-#include <cstdlib> // rand()
 #include <iostream>
 #include <algorithm>
+#include <utility>
 #include <cmath>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
 
 #include <GLFW/glfw3.h> // se ti serve per glfwGetTime
 
@@ -22,7 +26,8 @@ static std::string readFile(const std::string& filePath)
     return buffer.str();
 }
 
-static GLuint compileShader(const std::string &source, GLenum shaderType, const std::string& defines = "")
+// Defines iniettati subito dopo #version
+static std::string withDefines(const std::string& source, const std::string& defines)
 {
     std::string finalSource = source;
     if (!defines.empty()) {
@@ -36,50 +41,195 @@ static GLuint compileShader(const std::string &source, GLenum shaderType, const
             finalSource = defines + "\n" + finalSource;
         }
     }
+    return finalSource;
+}
+
+// Stesso hash PCG di update.comp: semina lo stato delle particelle e il passo del layout compatto
+static uint32_t pcgHash(uint32_t value)
+{
+    return Deterministic::hash(value);
+}
+
+static_assert(Deterministic::kSpeciesCount == kSpeciesCount, "La modalita' deterministica usa le stesse specie");
+
+// Compute shader da file attraverso la cache dei binari (defines iniettati dopo #version)
+static ProgramCache::Pending startComputeProgram(const std::string& path, const std::string& label, const std::string& defines = "")
+{
+    return ProgramCache::startCompute(withDefines(readFile(path), defines), label);
+}
 
-    GLuint shader = glCreateShader(shaderType);
-    const char* src = finalSource.c_str();
-    glShaderSource(shader, 1, &src, nullptr);
-    glCompileShader(shader);
+// Programmi avviati tutti prima di verificarne uno: con parallel_shader_compile il driver li compila
+// in contemporanea, senza estensione il costo resta quello della compilazione in sequenza
+struct ProgramBatch {
+    std::vector<std::pair<GLuint*, ProgramCache::Pending>> jobs;
 
-    // Controlla errori di compilazione
-    GLint success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
-        std::string shaderTypeStr = (shaderType == GL_COMPUTE_SHADER ? "COMPUTE" : "UNKNOWN");
-        throw std::runtime_error("Shader compile error (" + shaderTypeStr + "):\n" + infoLog);
+    void add(GLuint& target, const std::string& path, const std::string& label, const std::string& defines = "")
+    {
+        jobs.emplace_back(&target, startComputeProgram(path, label, defines));
+    }
+    void finish()
+    {
+        for (auto& job : jobs) *job.first = ProgramCache::finish(job.second);
+        jobs.clear();
     }
-    return shader;
+};
+
+static int log2Int(int n)
+{
+    int log = 0;
+    while ((1 << log) < n) ++log;
+    return log;
+}
+
+// Alloca lo SSBO legato a GL_SHADER_STORAGE_BUFFER e restituisce l'errore GL della sola allocazione.
+// Un errore gia' pendente appartiene ad altro codice: viene riportato nel log, non confuso con l'OOM.
+static GLenum allocateStorageBuffer(GLsizeiptr size, const char* what)
+{
+    GLenum pending = glGetError();
+    if (pending != GL_NO_ERROR) {
+        std::cout << "[GL] Error 0x" << std::hex << pending << std::dec << " pending before allocating " << what << std::endl;
+    }
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR && error != GL_OUT_OF_MEMORY) {
+        std::cout << "[GL] Error 0x" << std::hex << error << std::dec << " allocating " << what << std::endl;
+    }
+    return error;
+}
+
+// --------------------------------------------------
+// Tabella formati trail map (stesso ordine di TextureFormat)
+static const SimulationGPU::TextureFormatInfo kTextureFormats[] = {
+    { GL_R8,             GL_RED,  GL_UNSIGNED_BYTE,                 "#define FORMAT_R8",         "R8",         1, 1, false },
+    { GL_RG8,            GL_RG,   GL_UNSIGNED_BYTE,                 "#define FORMAT_RG8",        "RG8",        2, 2, false },
+    { GL_RGBA8,          GL_RGBA, GL_UNSIGNED_BYTE,                 "#define FORMAT_RGBA8",      "RGBA8",      4, 4, false },
+    { GL_R16F,           GL_RED,  GL_HALF_FLOAT,                    "#define FORMAT_R16F",       "R16F",       2, 1, true  },
+    { GL_RG16F,          GL_RG,   GL_HALF_FLOAT,                    "#define FORMAT_RG16F",      "RG16F",      4, 2, true  },
+    { GL_R11F_G11F_B10F, GL_RGB,  GL_UNSIGNED_INT_10F_11F_11F_REV,  "#define FORMAT_R11G11B10F", "R11G11B10F", 4, 3, true  },
+    { GL_RGBA16F,        GL_RGBA, GL_HALF_FLOAT,                    "#define FORMAT_RGBA16F",    "RGBA16F",    8, 4, true  },
+};
+static_assert(sizeof(kTextureFormats) / sizeof(kTextureFormats[0]) == static_cast<size_t>(SimulationGPU::TextureFormat::Count),
+              "kTextureFormats deve coprire tutti i TextureFormat");
+
+const SimulationGPU::TextureFormatInfo& SimulationGPU::getTextureFormatInfo(TextureFormat format)
+{
+    int idx = std::clamp(static_cast<int>(format), 0, static_cast<int>(TextureFormat::Count) - 1);
+    return kTextureFormats[idx];
+}
+
+size_t SimulationGPU::getTrailMemoryBytes(TextureFormat format) const
+{
+    // Due texture (ping-pong) alla risoluzione della trail map, con la catena mip
+    size_t texels = 0;
+    int w = m_trailWidth, h = m_trailHeight;
+    for (int level = 0; level < m_trailLevels; ++level) {
+        texels += static_cast<size_t>(w) * static_cast<size_t>(h);
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+    }
+    return 2ull * texels * static_cast<size_t>(getTextureFormatInfo(format).bytesPerTexel);
 }
 
 // --------------------------------------------------
 
 SimulationGPU::SimulationGPU(int particleCount, int width, int height)
     : m_maxParticles(particleCount)
+    , m_particleBudgetBytes(static_cast<size_t>(particleCount) * sizeof(GpuParticle))
+    , m_particleLayout(ParticleLayout::Standard)
+    , m_maxComputeStorageBlocks(0)
+    , m_backBufferFailed(false)
     , m_activeParticles(particleCount)
     , m_width(width)
     , m_height(height)
+    , m_trailDivisor(1)
+    , m_trailWidth(width)
+    , m_trailHeight(height)
     , m_targetParticles(particleCount)
     , m_rampingUp(true)
     , m_initialized(false)
+    , m_randomSeed(1u)
+    , m_rngStep(0u)
+    , m_seedBatch(0u)
+    , m_seedDistribution(SeedDistribution::CenterBurst)
+    , m_seedProgramID(0)
+    , m_seedImageTexture(0)
+    , m_emittersEnabled(false)
+    , m_emittersReady(false)
+    , m_emittedTotal(0u)
+    , m_compactProgramID(0)
+    , m_emitProgramID(0)
+    , m_particleCountBuffer(0)
+    , m_compactGroupBuffer(0)
+    , m_emitterBuffer(0)
     , m_currentBuffer(0)
     , m_textureIDIn(0)
     , m_textureIDOut(0)
+    , m_trailLevels(1)
+    , m_trailLodSampler(0)
+    , m_fieldIDIn(0)
+    , m_fieldIDOut(0)
+    , m_reactionProgramID(0)
+    , m_fftPackProgramID(0)
+    , m_fftProgramID(0)
+    , m_fftMultiplyProgramID(0)
+    , m_fftUnpackProgramID(0)
+    , m_fftDataBuffer(0)
+    , m_fftKernelBuffer(0)
+    , m_fftDataBytes(0)
+    , m_fftPaddedWidth(0)
+    , m_fftPaddedHeight(0)
+    , m_fftSpectrumRadius(0)
+    , m_fftSpectrumKernel(Fft::KernelType::Gaussian)
+    , m_fftSpectrumOnGpu(false)
     , m_updateProgramID(0)
     , m_blurProgramID(0)
+    , m_mipProgramID(0)
+    , m_shaderVariantsEnabled(true)
+    , m_parallelShaderCompile(false)
+    , m_updateVariantActive(false)
+    , m_updateVariantClock(0)
+    , m_rescaleProgramID(0)
     , m_sensorDistance(20.0f)
     , m_sensorAngle(0.785f)
     , m_turnAngle(0.785f)
+    , m_samplerSensing(true)
+    , m_trailPyramidEnabled(false)
+    , m_pyramidBaseDistance(16.0f)
+    , m_speciesCount(kSpeciesCount)
+    , m_speciesAssigned(kSpeciesCount)
+    , m_speciesTableValid(false)
+    , m_speciesTableBuffer(0)
+    , m_speciesProgramID(0)
+    , m_simParams()
+    , m_stepParams()
+    , m_simParamsValid(false)
+    , m_stepParamsValid(false)
+    , m_simParamsUBO(0)
+    , m_stepParamsUBO(0)
+    , m_submitMs(0.0f)
+    , m_submitSamples(0)
+    , m_reactionEnabled(false)
+    , m_reactionFeed(0.055f)
+    , m_reactionKill(0.062f)
+    , m_reactionDiffU(1.0f)
+    , m_reactionDiffV(0.5f)
+    , m_reactionSubsteps(4)
+    , m_reactionDeposit(0.05f)
+    , m_reactionSenseWeight(1.0f)
+    , m_diffusionMode(DiffusionMode::Direct)
+    , m_diffusionRadius(1)
+    , m_fftKernel(Fft::KernelType::Gaussian)
+    , m_leniaGrowth(false)
+    , m_leniaMu(0.15f)
+    , m_leniaSigma(0.015f)
+    , m_leniaDt(0.1f)
+    , m_speciesChannels(false)
+    , m_speciesMatrixDirty(true)
+    , m_speciesMatrixUBO(0)
     , m_speedMin(10.0f)
     , m_speedMax(300.0f)
     , m_speed(100.0f)
     , m_trailFade(0.99f)
-    , m_toneExposure(3.0f)
-    , m_autoDimThreshold(0.25f)
-    , m_autoDimStrength(0.5f)
-    , m_autoDimGlobal(4.0f)
     , m_inertia(0.85f)
     , m_restitution(1.0f)
     , m_randomWeight(0.05f)
@@ -116,48 +266,189 @@ SimulationGPU::SimulationGPU(int particleCount, int width, int height)
     , m_particleNextBuffer(0)
     , m_gridResetProgramID(0)
     , m_gridBuildProgramID(0)
+    , m_zoneForcesEnabled(false)
+    , m_zoneCellSize(32.0f)
+    , m_zoneRadius(4)
+    , m_zoneStrength(0.05f)
+    , m_zoneGridWidth(0)
+    , m_zoneGridHeight(0)
+    , m_zoneBufferCellSize(0.0f)
+    , m_zoneCountBuffer(0)
+    , m_zoneSatBuffer(0)
+    , m_zoneCountProgramID(0)
+    , m_zoneSatProgramID(0)
     , m_textureFormat(TextureFormat::RGBA8)
+    , m_lastGridMs(0.0f)
+    , m_lastUpdateMs(0.0f)
+    , m_lastBlurMs(0.0f)
+    , m_lastReactionMs(0.0f)
+    , m_lastEmitterMs(0.0f)
+    , m_activityEnabled(false)
+    , m_activityInterval(8)
+    , m_activityStepCounter(0)
+    , m_activityProgramID(0)
+    , m_activityTileBuffer(0)
+    , m_activityPartialBuffer(0)
+    , m_activitySet(0)
+    , m_activityTilesX(0)
+    , m_activityTilesY(0)
+    , m_activityPrevEnergy(0.0f)
+    , m_deterministicEnabled(false)
+    , m_deterministicReference(false)
+    , m_deterministicReady(false)
+    , m_deterministicHashInterval(600)
+    , m_deterministicAgents(0)
+    , m_deterministicTrailWidth(0)
+    , m_deterministicTrailHeight(0)
+    , m_deterministicStep(0)
+    , m_deterministicHash(0)
+    , m_deterministicDiverged(false)
+    , m_detUpdateProgramID(0)
+    , m_detTrailProgramID(0)
+    , m_detAgentBuffer(0)
+    , m_detDepositBuffer(0)
+    , m_detDirectionBuffer(0)
 {
     m_color1[0] = 0.0f; m_color1[1] = 1.0f; m_color1[2] = 1.0f; // Cyan
     m_color2[0] = 1.0f; m_color2[1] = 0.0f; m_color2[2] = 1.0f; // Magenta
     m_particleBuffers[0] = 0;
     m_particleBuffers[1] = 0;
+    m_particleLifeBuffers[0] = m_particleLifeBuffers[1] = 0;
+    for (size_t& offset : m_particleStreamOffsets) offset = 0;
+    m_particleBufferSize = 0;
+    m_detTrailBuffers[0] = m_detTrailBuffers[1] = 0;
+    m_diffusionQueries[0] = 0;
+    m_diffusionQueries[1] = 0;
+    m_activityMetricBuffers[0] = m_activityMetricBuffers[1] = 0;
+    m_activityFences[0] = m_activityFences[1] = nullptr;
+    // Species 1: sensori piu' corti e aperti, sterzata ampia (caotica); Species 2: sensori lunghi e
+    // stretti, sterzata dolce (esploratrice). La tinta ruota di un terzo per specie.
+    m_speciesSettings[1].sensorScale = 0.8f;
+    m_speciesSettings[1].sensorAngleScale = 1.2f;
+    m_speciesSettings[1].turnScale = 1.1f;
+    m_speciesSettings[1].hueShift = 0.33f;
+    m_speciesSettings[2].sensorScale = 1.3f;
+    m_speciesSettings[2].sensorAngleScale = 0.8f;
+    m_speciesSettings[2].turnScale = 0.9f;
+    m_speciesSettings[2].hueShift = 0.66f;
+    // Zone: la specie 0 attrae verso i propri gruppi, 1 e 2 fanno vortici opposti
+    const float zoneDefaults[kSpeciesCount][2] = { {1.0f, 0.0f}, {0.0f, 1.0f}, {0.0f, -1.0f} };
+    for (int i = 0; i < kSpeciesCount; ++i) {
+        m_speciesZoneForce[i][0] = zoneDefaults[i][0];
+        m_speciesZoneForce[i][1] = zoneDefaults[i][1];
+    }
+    // Default: ogni specie segue solo la propria traccia
+    for (int i = 0; i < kSpeciesCount; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            m_speciesMatrix[i][j] = (i == j) ? 1.0f : 0.0f;
+        }
+    }
+    for (int i = 0; i < 2; ++i) {
+        m_timeQuerySteady[i] = false;
+        m_timeQueryFormat[i] = m_textureFormat;
+        m_timeQuerySampler[i] = false;
+    }
 }
 
 SimulationGPU::~SimulationGPU()
 {
     // Rilascia risorse
-    if (m_updateProgramID) glDeleteProgram(m_updateProgramID);
-    if (m_blurProgramID) glDeleteProgram(m_blurProgramID);
+    releaseFormatPrograms(false);
+    if (m_reactionProgramID) glDeleteProgram(m_reactionProgramID);
+    if (m_fftPackProgramID) glDeleteProgram(m_fftPackProgramID);
+    if (m_fftProgramID) glDeleteProgram(m_fftProgramID);
+    if (m_fftMultiplyProgramID) glDeleteProgram(m_fftMultiplyProgramID);
+    if (m_fftUnpackProgramID) glDeleteProgram(m_fftUnpackProgramID);
     if (m_gridResetProgramID) glDeleteProgram(m_gridResetProgramID);
     if (m_gridBuildProgramID) glDeleteProgram(m_gridBuildProgramID);
+    if (m_zoneCountProgramID) glDeleteProgram(m_zoneCountProgramID);
+    if (m_zoneSatProgramID) glDeleteProgram(m_zoneSatProgramID);
+    if (m_activityProgramID) glDeleteProgram(m_activityProgramID);
+    if (m_detUpdateProgramID) glDeleteProgram(m_detUpdateProgramID);
+    if (m_seedProgramID) glDeleteProgram(m_seedProgramID);
+    if (m_compactProgramID) glDeleteProgram(m_compactProgramID);
+    if (m_emitProgramID) glDeleteProgram(m_emitProgramID);
+    if (m_rescaleProgramID) glDeleteProgram(m_rescaleProgramID);
+    if (m_speciesProgramID) glDeleteProgram(m_speciesProgramID);
+    releaseActivityBuffers();
+    releaseDeterministicBuffers();
+    releaseEmitterBuffers();
 
     glDeleteTextures(1, &m_textureIDIn);
     glDeleteTextures(1, &m_textureIDOut);
+    glDeleteTextures(1, &m_fieldIDIn);
+    glDeleteTextures(1, &m_fieldIDOut);
+    glDeleteTextures(1, &m_seedImageTexture);
+    glDeleteSamplers(1, &m_trailLodSampler);
     glDeleteBuffers(2, m_particleBuffers);
     glDeleteBuffers(1, &m_gridHeadBuffer);
     glDeleteBuffers(1, &m_particleNextBuffer);
+    glDeleteBuffers(1, &m_zoneCountBuffer);
+    glDeleteBuffers(1, &m_zoneSatBuffer);
+    glDeleteBuffers(1, &m_speciesMatrixUBO);
+    glDeleteBuffers(1, &m_simParamsUBO);
+    glDeleteBuffers(1, &m_stepParamsUBO);
+    glDeleteBuffers(1, &m_speciesTableBuffer);
+    glDeleteBuffers(1, &m_fftDataBuffer);
+    glDeleteBuffers(1, &m_fftKernelBuffer);
     
-    glDeleteQueries(4, m_timeQueries);
+    m_passGraph.release();
+    glDeleteQueries(2, m_diffusionQueries);
 }
 
 void SimulationGPU::initialize()
 {
     if (m_initialized) return;
 
+    m_parallelShaderCompile = ProgramCache::hasParallelCompile();
+    glGetIntegerv(GL_MAX_COMPUTE_SHADER_STORAGE_BLOCKS, &m_maxComputeStorageBlocks);
+    if (!isParticleLayoutSupported(m_particleLayout)) {
+        std::cout << "[Particles] Layout " << Particles::label(m_particleLayout) << " needs "
+                  << Particles::storageBlocks(m_particleLayout) + kMaxShaderOwnStorageBlocks << " SSBO blocks, driver allows "
+                  << m_maxComputeStorageBlocks << ": using " << Particles::label(ParticleLayout::Standard) << std::endl;
+        m_particleLayout = ParticleLayout::Standard;
+    }
     createComputeShaders();
     createTextures();
     createGridBuffers();
 
-    // Crea i due SSBO per le particelle
-    glGenBuffers(2, m_particleBuffers);
-    size_t bufferSize = static_cast<size_t>(m_maxParticles) * sizeof(GpuParticle);
-
-    for(int i=0; i<2; ++i) {
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_particleBuffers[i]);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, bufferSize, nullptr, GL_DYNAMIC_COPY);
-    }
+    // Sampler per il sensing: bilineare sul livello 0, trilineare tra i livelli della piramide
+    glGenSamplers(1, &m_trailLodSampler);
+    glSamplerParameteri(m_trailLodSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glSamplerParameteri(m_trailLodSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(m_trailLodSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(m_trailLodSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // Matrice di interazione tra specie (uniform block std140, binding 0)
+    glGenBuffers(1, &m_speciesMatrixUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_speciesMatrixUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(m_speciesMatrix), m_speciesMatrix, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    m_speciesMatrixDirty = false;
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, m_speciesMatrixUBO);
+
+    // Parametri dell'update (SimParams / StepParams): agganciati qui una volta, riempiti al primo passo
+    glGenBuffers(1, &m_simParamsUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_simParamsUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(UpdateSimParams), nullptr, GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &m_stepParamsUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_stepParamsUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(UpdateStepParams), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, kSimParamsBinding, m_simParamsUBO);
+    glBindBufferBase(GL_UNIFORM_BUFFER, kStepParamsBinding, m_stepParamsUBO);
+    m_simParamsValid = false;
+    m_stepParamsValid = false;
+
+    // Tabella delle specie per l'update (SSBO, binding 27), riempita al primo passo
+    glGenBuffers(1, &m_speciesTableBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_speciesTableBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(m_speciesTable), nullptr, GL_DYNAMIC_DRAW);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    m_speciesTableValid = false;
+
+    // Crea i due SSBO per le particelle
+    createParticleBuffers();
 
     // Inizializza le particelle (all at center now for ramp-up)
     initializeParticles();
@@ -168,7 +459,8 @@ void SimulationGPU::initialize()
     m_initialized = true;
     
     // Performance Queries
-    glGenQueries(4, m_timeQueries);
+    m_passGraph.initialize(static_cast<int>(SimPass::Count));
+    glGenQueries(2, m_diffusionQueries);
 }
 
 void SimulationGPU::setActiveParticleCount(int count)
@@ -176,31 +468,15 @@ void SimulationGPU::setActiveParticleCount(int count)
     int clamped = std::max(1, std::min(count, m_maxParticles));
     if (clamped == m_activeParticles) return;
 
+    // Con gli emettitori e' solo il tetto della popolazione: nascono e muoiono in GPU
+    if (m_emittersEnabled) {
+        m_targetParticles = m_activeParticles = clamped;
+        return;
+    }
+
     // If we are enabling more particles, seed them with random values.
     if (clamped > m_activeParticles) {
-        int start = m_activeParticles;
-        int toInit = clamped - m_activeParticles;
-
-        std::vector<GpuParticle> particles(toInit);
-        for (int i = 0; i < toInit; ++i)
-        {
-            particles[i].position[0] = static_cast<float>(rand() % m_width);
-            particles[i].position[1] = static_cast<float>(rand() % m_height);
-            particles[i].angle = static_cast<float>(rand()) / RAND_MAX * 6.28318530718f;
-
-            float r = static_cast<float>(rand()) / RAND_MAX;
-            particles[i].speed = m_speedMin + r * (m_speedMax - m_speedMin);
-            particles[i].species = static_cast<float>(rand() % 3);
-            particles[i]._pad[0] = 0; particles[i]._pad[1] = 0; particles[i]._pad[2] = 0;
-        }
-
-        GLintptr offset = static_cast<GLintptr>(start) * sizeof(GpuParticle);
-        GLsizeiptr sizeBytes = static_cast<GLsizeiptr>(toInit) * sizeof(GpuParticle);
-        for (int i = 0; i < 2; ++i) {
-            glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_particleBuffers[i]);
-            glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, sizeBytes, particles.data());
-        }
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        seedParticles(m_activeParticles, clamped - m_activeParticles, SeedDistribution::Uniform);
     }
 
     m_targetParticles = clamped;
@@ -215,17 +491,31 @@ void SimulationGPU::setActiveParticleCount(int count)
 void SimulationGPU::update(float dt, float mouseX, float mouseY, bool mousePressed, int mouseMode)
 {
     if (!m_initialized) return;
+
+    // Modalita' deterministica: passo intero separato, il resto della pipeline resta fermo
+    if (m_deterministicEnabled) {
+        stepDeterministic();
+        return;
+    }
+    const auto submitStart = std::chrono::steady_clock::now();
     
+    // Nuovo numero di specie: le particelle presenti passano ai blocchi della nuova suddivisione
+    if (m_speciesAssigned != m_speciesCount) {
+        assignSpecies();
+    }
+
     const int activeCount = m_activeParticles;
     
-    // Ramp Up Logic
-    if (activeCount < m_targetParticles) {
+    // Ramp Up Logic (con gli emettitori la popolazione nasce in runEmitters)
+    if (m_emittersEnabled) {
+        // niente ramp-up
+    } else if (activeCount < m_targetParticles) {
         int growthRate = std::max(100, m_targetParticles / 100); // 1% per frame, min 100
         int nextCount = std::min(activeCount + growthRate, m_targetParticles);
         
         // If we are adding particles, reset their position to center to get the "explosion" effect
         if (nextCount > activeCount) {
-             resetParticlePositions(activeCount, nextCount - activeCount);
+             seedParticles(activeCount, nextCount - activeCount, m_seedDistribution);
              m_activeParticles = nextCount;
         }
     } else if (activeCount > m_targetParticles) {
@@ -236,129 +526,151 @@ void SimulationGPU::update(float dt, float mouseX, float mouseY, bool mousePress
     m_speedSampleTimer += dt;
     bool shouldSampleSpeed = (m_colorSource == 2 && m_speedSampleTimer >= m_speedSampleInterval);
 
-    // 0. Start Timer
-    glQueryCounter(m_timeQueries[0], GL_TIMESTAMP);
+    // Tempi del set registrato due passi fa (se pronti) prima di riscriverlo
+    if (m_passGraph.beginFrame()) {
+        printPerformanceStats();
+    }
+
+    // Il secondo buffer serve solo se l'update legge i vicini o se la compattazione sposta le particelle
+    ensureParticleBackBuffer(m_boidsEnabled || m_collisionsEnabled || m_emittersEnabled);
+
+    // Ogni pass dichiara cosa legge e scrive prima dei suoi dispatch: le barriere le mette il grafo
+
+    // --- PASS -1: emettitori (compattazione delle vive + nuove particelle), conteggio solo in GPU ---
+    m_passGraph.run(static_cast<int>(SimPass::Emitters), "Emitters", m_emittersEnabled, [&] { runEmitters(dt); });
 
     // --- PASS 0: Grid Reset & Build (needed for Boids or Collisions) ---
-    if (m_boidsEnabled || m_collisionsEnabled) {
+    const bool neighbours = m_boidsEnabled || m_collisionsEnabled;
+    m_passGraph.run(static_cast<int>(SimPass::Grid), "Grid", neighbours, [&] {
         rebuildGridIfNeeded();
-        // ... (Calls Grid Shaders)
         glUseProgram(m_gridResetProgramID);
         int numCells = m_gridWidth * m_gridHeight;
         glUniform1i(glGetUniformLocation(m_gridResetProgramID, "uNumCells"), numCells);
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_gridHeadBuffer);
+        m_passGraph.access({ PassGraph::buffer(m_gridHeadBuffer, PassGraph::Access::StorageWrite) });
         glDispatchCompute((numCells + 255) / 256, 1, 1);
-        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
         glUseProgram(m_gridBuildProgramID);
-        glUniform1i(glGetUniformLocation(m_gridBuildProgramID, "uParticleCount"), activeCount);
         glUniform1f(glGetUniformLocation(m_gridBuildProgramID, "uCellSize"), m_cellSize);
         glUniform1i(glGetUniformLocation(m_gridBuildProgramID, "uGridWidth"), m_gridWidth);
         glUniform1i(glGetUniformLocation(m_gridBuildProgramID, "uGridHeight"), m_gridHeight);
         
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_particleBuffers[m_currentBuffer]);
+        bindParticleStreams(m_currentBuffer, false);
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_gridHeadBuffer);
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_particleNextBuffer);
-        
-        glDispatchCompute((activeCount + 255) / 256, 1, 1);
-        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-    }
+        m_passGraph.access({ PassGraph::buffer(m_particleBuffers[m_currentBuffer], PassGraph::Access::StorageRead),
+                             PassGraph::buffer(m_gridHeadBuffer, PassGraph::Access::StorageWrite),
+                             PassGraph::buffer(m_particleNextBuffer, PassGraph::Access::StorageWrite) });
+        dispatchParticles(activeCount, 256);
+    });
     
-    // 1. Grid Done
-    glQueryCounter(m_timeQueries[1], GL_TIMESTAMP);
+    // --- PASS 0a: densita' per specie a zone + summed-area table ---
+    m_passGraph.run(static_cast<int>(SimPass::Zones), "Zones", m_zoneForcesEnabled, [&] { buildZoneDensity(activeCount); });
+
+    // --- PASS 0b: Reaction-Diffusion (Gray-Scott) ---
+    const bool reactionEnabled = m_reactionEnabled;
+    m_passGraph.run(static_cast<int>(SimPass::Reaction), "Reaction", reactionEnabled, [&] { runReactionPass(); });
+
+    // Sensing via sampler: prima il blur (In -> Out), poi l'update legge In (frame precedente,
+    // sola lettura) e deposita in Out. Nessuna race tra sensori e depositi dello stesso dispatch.
+    const bool samplerSensing = m_samplerSensing;
+    m_passGraph.run(static_cast<int>(SimPass::Blur), "Blur", samplerSensing, [&] { runBlurPass(); });
+    const GLuint depositTexture = samplerSensing ? m_textureIDOut : m_textureIDIn;
 
     // --- PASS 1: Particle Update & Deposit ---
-    {
-       glUseProgram(m_updateProgramID);
-       
-       // ... Uniforms and Bindings ...
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uDt"), dt);
-       glUniform1i(glGetUniformLocation(m_updateProgramID, "uParticleCount"), activeCount);
-       glUniform2f(glGetUniformLocation(m_updateProgramID, "uSimSize"), (float)m_width, (float)m_height);
-       glUniform1i(glGetUniformLocation(m_updateProgramID, "uBoundaryMode"), m_boundaryMode);
-       
-       glUniform1i(glGetUniformLocation(m_updateProgramID, "uPhysarumEnabled"), m_physarumEnabled ? 1 : 0);
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uPhysarumIntensity"), m_physarumIntensity);
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uSensorDistance"), m_sensorDistance);
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uSensorAngle"), m_sensorAngle);
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uTurnAngle"), m_turnAngle);
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uSpeed"), m_speed);
-        glUniform1f(glGetUniformLocation(m_updateProgramID, "uSpeedMin"), m_speedMin);
-        glUniform1f(glGetUniformLocation(m_updateProgramID, "uSpeedMax"), m_speedMax);
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uInertia"), m_inertia);
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uRestitution"), m_restitution);
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uRandomWeight"), m_randomWeight);
-       
-       // Colors
-       glUniform3fv(glGetUniformLocation(m_updateProgramID, "uColor1"), 1, m_color1);
-       glUniform3fv(glGetUniformLocation(m_updateProgramID, "uColor2"), 1, m_color2);
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uColorOffset"), m_colorOffset);
-       glUniform1i(glGetUniformLocation(m_updateProgramID, "uColorSource"), m_colorSource == 0 ? 0 : 1);
-
-       float effectiveMin = m_colorSpeedMin;
-       float effectiveMax = m_colorSpeedMax;
-       if (m_colorSource == 2 && m_autoSpeedValid) {
-           effectiveMin = m_autoSpeedMin;
-           effectiveMax = m_autoSpeedMax;
+    m_passGraph.run(static_cast<int>(SimPass::Update), "Update", true, [&] {
+       // Variante specializzata sulle funzionalita' attive se gia' compilata, altrimenti il programma generico
+       glUseProgram(selectUpdateProgram(samplerSensing, reactionEnabled, mouseMode));
+
+       // Parametri nei blocchi SimParams / StepParams (binding 1 e 2, agganciati in initialize):
+       // nessuna ricerca di uniform per nome, ricarica solo di quello che e' cambiato
+       uploadUpdateParams(dt, mouseX, mouseY, mousePressed, mouseMode, samplerSensing, reactionEnabled);
+       if (m_particleLayout == ParticleLayout::Packed) {
+           // Layout compatto: lo stato PCG del passo deriva dall'indice e da questo hash di seme e passo
+           glUniform1ui(Particles::kRngStepLocation, pcgHash(m_randomSeed ^ pcgHash(m_rngStep)));
        }
-       if (effectiveMax <= effectiveMin) {
-           effectiveMax = effectiveMin + 1.0f;
+       ++m_rngStep;
+
+       // Sensori, sterzata, velocita', deposito e pesi dei boids per specie: ricaricati solo se cambiano
+       uploadSpeciesTable();
+       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 27, m_speciesTableBuffer);
+
+       // Canali per specie: la matrice (binding 0) si ricarica solo quando cambia
+       if (m_speciesMatrixDirty) {
+           glBindBuffer(GL_UNIFORM_BUFFER, m_speciesMatrixUBO);
+           glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(m_speciesMatrix), m_speciesMatrix);
+           glBindBuffer(GL_UNIFORM_BUFFER, 0);
+           m_speciesMatrixDirty = false;
        }
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uColorSpeedMin"), effectiveMin);
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uColorSpeedMax"), effectiveMax);
-
-       glUniform1i(glGetUniformLocation(m_updateProgramID, "uCollisionsEnabled"), m_collisionsEnabled ? 1 : 0);
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uCollisionRadius"), m_collisionRadius);
-
-       glUniform1i(glGetUniformLocation(m_updateProgramID, "uBoidsEnabled"), m_boidsEnabled ? 1 : 0);
-       if (m_boidsEnabled || m_collisionsEnabled) {
-           glUniform1f(glGetUniformLocation(m_updateProgramID, "uAlignmentWeight"), m_alignmentWeight);
-           glUniform1f(glGetUniformLocation(m_updateProgramID, "uSeparationWeight"), m_separationWeight);
-           glUniform1f(glGetUniformLocation(m_updateProgramID, "uCohesionWeight"), m_cohesionWeight);
-           glUniform1f(glGetUniformLocation(m_updateProgramID, "uBoidsRadius"), m_boidsRadius);
-           glUniform1f(glGetUniformLocation(m_updateProgramID, "uCellSize"), m_cellSize);
-           glUniform1i(glGetUniformLocation(m_updateProgramID, "uGridWidth"), m_gridWidth);
-           glUniform1i(glGetUniformLocation(m_updateProgramID, "uGridHeight"), m_gridHeight);
-           
-           glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_gridHeadBuffer);
-           glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_particleNextBuffer);
-       }
-
-       glUniform2f(glGetUniformLocation(m_updateProgramID, "uMousePos"), mouseX, mouseY);
-       glUniform1i(glGetUniformLocation(m_updateProgramID, "uMousePressed"), mousePressed ? 1 : 0);
-       glUniform1i(glGetUniformLocation(m_updateProgramID, "uMouseMode"), mouseMode);
-       glUniform1i(glGetUniformLocation(m_updateProgramID, "uMouseFalloff"), m_mouseFalloff);
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uMouseStrength"), m_mouseStrength);
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uMouseGaussianSigma"), m_mouseGaussianSigma);
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uMouseOscFreq"), m_mouseOscFreq);
-       glUniform1i(glGetUniformLocation(m_updateProgramID, "uMouseRingOverlay"), m_mouseRingOverlay ? 1 : 0);
-       glUniform1f(glGetUniformLocation(m_updateProgramID, "uMouseRingRadius"), m_mouseRingRadius);
-
-       int nextBuffer = 1 - m_currentBuffer;
-       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_particleBuffers[m_currentBuffer]);
-       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_particleBuffers[nextBuffer]);
 
-        GLint glFormat = GL_RGBA8;
-        if (m_textureFormat == TextureFormat::R8) glFormat = GL_R8;
-        else if (m_textureFormat == TextureFormat::RG8) glFormat = GL_RG8;
+       // Campo di reazione: V letto via sampler (unita' 1), feed depositato come image (unita' 3)
+       glActiveTexture(GL_TEXTURE1);
+       glBindTexture(GL_TEXTURE_2D, m_fieldIDIn);
+       glActiveTexture(GL_TEXTURE0);
+       glBindImageTexture(3, m_fieldIDIn, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
 
-        glBindImageTexture(2, m_textureIDIn, 0, GL_FALSE, 0, GL_READ_WRITE, glFormat);
+       // Trail via sampler (unita' 0): in modalita' legacy il livello 0 si legge come image, i livelli grossi della piramide qui
+       glBindTexture(GL_TEXTURE_2D, m_textureIDIn);
+       glBindSampler(0, m_trailLodSampler);
 
-       GLuint groupSize = 128; 
-       GLuint numGroups = (activeCount + groupSize - 1) / groupSize;
-       glDispatchCompute(numGroups, 1, 1);
+       if (neighbours) {
+           glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_gridHeadBuffer);
+           glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_particleNextBuffer);
+           m_passGraph.access({ PassGraph::buffer(m_gridHeadBuffer, PassGraph::Access::StorageRead),
+                                PassGraph::buffer(m_particleNextBuffer, PassGraph::Access::StorageRead) });
+       }
+       if (m_zoneForcesEnabled) {
+           glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kZoneSatBinding, m_zoneSatBuffer);
+           m_passGraph.access({ PassGraph::buffer(m_zoneSatBuffer, PassGraph::Access::StorageRead) });
+       }
 
-       glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+       // In place senza letture dei vicini: ogni invocazione legge il proprio record prima di riscriverlo
+       // (anche quando il secondo buffer esiste solo per la compattazione degli emettitori)
+       const bool pingPong = m_particleBuffers[1] && neighbours;
+       int nextBuffer = pingPong ? 1 - m_currentBuffer : m_currentBuffer;
+       bindParticleStreams(m_currentBuffer, false);
+       bindParticleStreams(nextBuffer, true);
+
+        GLenum glFormat = getTextureFormatInfo(m_textureFormat).internalFormat;
+        glBindImageTexture(2, depositTexture, 0, GL_FALSE, 0, GL_READ_WRITE, glFormat);
+
+       m_passGraph.access({ PassGraph::buffer(m_particleBuffers[m_currentBuffer], PassGraph::Access::StorageRead),
+                            PassGraph::buffer(m_particleBuffers[nextBuffer], PassGraph::Access::StorageWrite),
+                            PassGraph::texture(m_textureIDIn, PassGraph::Access::Sampled),
+                            PassGraph::texture(depositTexture, PassGraph::Access::ImageWrite, 0),
+                            PassGraph::texture(m_fieldIDIn, PassGraph::Access::Sampled),
+                            PassGraph::texture(m_fieldIDIn, PassGraph::Access::ImageWrite, 0) });
+       dispatchParticles(activeCount, 128);
+
+       glBindSampler(0, 0);
+       glBindTexture(GL_TEXTURE_2D, 0);
+       glActiveTexture(GL_TEXTURE1);
+       glBindTexture(GL_TEXTURE_2D, 0);
+       glActiveTexture(GL_TEXTURE0);
        m_currentBuffer = nextBuffer;
-    }
+    });
+
     if (shouldSampleSpeed) {
         m_speedSampleTimer = 0.0f;
-        int sampleCount = std::min(m_activeParticles, m_speedSampleCount);
+        // Con gli emettitori m_activeParticles e' il tetto: oltre le vive restano record di particelle morte
+        // o mai nate. Le vive sono compattate in testa, il loro numero si legge dal record corrente.
+        int liveCount = m_activeParticles;
+        if (m_emittersEnabled) {
+            liveCount = 0;
+            if (m_emittersReady) {
+                GpuParticleCount counts = {};
+                m_passGraph.access({ PassGraph::buffer(m_particleCountBuffer, PassGraph::Access::Transfer) });
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_particleCountBuffer);
+                glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counts), &counts);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+                liveCount = static_cast<int>(std::min<uint32_t>(counts.liveCount, static_cast<uint32_t>(m_activeParticles)));
+            }
+        }
+        int sampleCount = std::min(liveCount, m_speedSampleCount);
         if (sampleCount > 0) {
-            std::vector<GpuParticle> sample(sampleCount);
-            glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_particleBuffers[m_currentBuffer]);
-            glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, static_cast<GLsizeiptr>(sampleCount * sizeof(GpuParticle)), sample.data());
-            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            std::vector<GpuParticle> sample;
+            m_passGraph.access({ PassGraph::buffer(m_particleBuffers[m_currentBuffer], PassGraph::Access::Transfer) });
+            downloadParticles(0, sampleCount, sample);
 
             float minS = sample[0].speed;
             float maxS = sample[0].speed;
@@ -374,188 +686,1217 @@ void SimulationGPU::update(float dt, float mouseX, float mouseY, bool mousePress
         }
     }
     
-    // 2. Update Done
-    glQueryCounter(m_timeQueries[2], GL_TIMESTAMP);
+    // --- PASS 2: Blur (sensing legacy: dopo l'update) ---
+    m_passGraph.run(static_cast<int>(SimPass::Blur), "Blur", !samplerSensing, [&] { runBlurPass(); });
+    std::swap(m_textureIDIn, m_textureIDOut);
+
+    // --- PASS 3: Trail Pyramid (sensing multi-scala del passo successivo) ---
+    m_passGraph.run(static_cast<int>(SimPass::Pyramid), "Pyramid", m_trailPyramidEnabled && m_trailLevels > 1,
+                    [&] { buildTrailPyramid(); });
+
+    // --- PASS 4: metriche di attivita' (stato stazionario), ogni m_activityInterval step ---
+    const bool sampleActivityNow = m_activityEnabled && ++m_activityStepCounter >= m_activityInterval;
+    m_passGraph.run(static_cast<int>(SimPass::Activity), "Activity", sampleActivityNow, [&] {
+        m_activityStepCounter = 0;
+        sampleActivity();
+    });
+
+    // Condizioni del set appena registrato, lette quando i suoi tempi arrivano
+    const int set = m_passGraph.frameSet();
+    m_timeQuerySteady[set] = m_emittersEnabled || (m_activeParticles == m_targetParticles);
+    m_timeQueryFormat[set] = m_textureFormat;
+    m_timeQuerySampler[set] = samplerSensing;
+    // Le scritture ancora pendenti diventano visibili al rendering e a tutto cio' che sta fuori dal grafo
+    m_passGraph.endFrame();
+
+    // Costo CPU del passo (media mobile come i tempi per formato)
+    const float submitMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - submitStart).count();
+    const float submitAlpha = (m_submitSamples < 20) ? 1.0f / static_cast<float>(m_submitSamples + 1) : 0.05f;
+    m_submitMs += (submitMs - m_submitMs) * submitAlpha;
+    m_submitSamples++;
+}
 
-    // --- PASS 2: Blur ---
-    {
-       glUseProgram(m_blurProgramID);
+void SimulationGPU::runReactionPass()
+{
+    glUseProgram(m_reactionProgramID);
+
+    glUniform2i(glGetUniformLocation(m_reactionProgramID, "uFieldSize"), m_trailWidth, m_trailHeight);
+    glUniform1f(glGetUniformLocation(m_reactionProgramID, "uDiffU"), m_reactionDiffU);
+    glUniform1f(glGetUniformLocation(m_reactionProgramID, "uDiffV"), m_reactionDiffV);
+    glUniform1f(glGetUniformLocation(m_reactionProgramID, "uFeed"), m_reactionFeed);
+    glUniform1f(glGetUniformLocation(m_reactionProgramID, "uKill"), m_reactionKill);
+
+    GLuint gx = (m_trailWidth  + 15) / 16;
+    GLuint gy = (m_trailHeight + 15) / 16;
+
+    // Ogni dispatch fonde fino a kReactionFusedSubsteps sotto-passi in shared memory
+    int remaining = m_reactionSubsteps;
+    bool firstPass = true;
+    while (remaining > 0) {
+        int substeps = std::min(remaining, kReactionFusedSubsteps);
+        glUniform1i(glGetUniformLocation(m_reactionProgramID, "uSubsteps"), substeps);
+        // Il feed delle particelle entra una volta sola: i dispatch successivi lo trovano azzerato
+        glUniform1f(glGetUniformLocation(m_reactionProgramID, "uFeedGain"), firstPass ? 1.0f / static_cast<float>(substeps) : 0.0f);
+
+        glBindImageTexture(0, m_fieldIDIn,  0, GL_FALSE, 0, GL_READ_ONLY,  GL_RGBA16F);
+        glBindImageTexture(1, m_fieldIDOut, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        m_passGraph.access({ PassGraph::texture(m_fieldIDIn, PassGraph::Access::ImageRead, 0),
+                             PassGraph::texture(m_fieldIDOut, PassGraph::Access::ImageWrite, 0) });
+        glDispatchCompute(gx, gy, 1);
+
+        std::swap(m_fieldIDIn, m_fieldIDOut);
+        remaining -= substeps;
+        firstPass = false;
+    }
+}
+
+void SimulationGPU::runBlurPass()
+{
+    // La FFT GPU non supporta linee oltre Fft::kMaxGpuLength: si ripiega sul blur diretto
+    switch (m_diffusionMode) {
+    case DiffusionMode::FftGpu:
+        if (isFftGpuAvailable(m_diffusionRadius)) {
+            runFftGpu(m_diffusionRadius);
+            return;
+        }
+        break;
+    case DiffusionMode::FftCpu:
+        runFftCpu(m_diffusionRadius);
+        return;
+    default:
+        break;
+    }
+    runDirectBlur(m_diffusionRadius);
+}
+
+void SimulationGPU::runDirectBlur(int radius)
+{
+    // Lo stato resta lineare (densita'): tone mapping e auto-dim sono nel pass finale, una volta per frame
+    glUseProgram(m_blurProgramID);
+
+    glUniform2i(glGetUniformLocation(m_blurProgramID, "uImageSize"), m_trailWidth, m_trailHeight);
+    glUniform1f(glGetUniformLocation(m_blurProgramID, "uFade"), m_trailFade);
+    glUniform1i(glGetUniformLocation(m_blurProgramID, "uRadius"), radius);
+
+    GLenum glFormat = getTextureFormatInfo(m_textureFormat).internalFormat;
+    glBindImageTexture(0, m_textureIDIn,  0, GL_FALSE, 0, GL_READ_ONLY,  glFormat);
+    glBindImageTexture(1, m_textureIDOut, 0, GL_FALSE, 0, GL_WRITE_ONLY, glFormat);
+
+    GLuint gx = (m_trailWidth  + 15) / 16;
+    GLuint gy = (m_trailHeight + 15) / 16;
+    m_passGraph.access({ PassGraph::texture(m_textureIDIn, PassGraph::Access::ImageRead, 0),
+                         PassGraph::texture(m_textureIDOut, PassGraph::Access::ImageWrite, 0) });
+    glDispatchCompute(gx, gy, 1);
+}
+
+bool SimulationGPU::isFftGpuAvailable(int radius) const
+{
+    int paddedWidth, paddedHeight;
+    Fft::paddedSize(m_trailWidth, m_trailHeight, radius, paddedWidth, paddedHeight);
+    return paddedWidth <= Fft::kMaxGpuLength && paddedHeight <= Fft::kMaxGpuLength;
+}
+
+void SimulationGPU::prepareFftSpectrum(int radius, bool uploadToGpu)
+{
+    int paddedWidth, paddedHeight;
+    Fft::paddedSize(m_trailWidth, m_trailHeight, radius, paddedWidth, paddedHeight);
+
+    const bool spectrumChanged = m_fftSpectrum.empty() || paddedWidth != m_fftPaddedWidth || paddedHeight != m_fftPaddedHeight
+                              || radius != m_fftSpectrumRadius || m_fftKernel != m_fftSpectrumKernel;
+    if (spectrumChanged) {
+        m_fftPaddedWidth = paddedWidth;
+        m_fftPaddedHeight = paddedHeight;
+        m_fftSpectrumRadius = radius;
+        m_fftSpectrumKernel = m_fftKernel;
+        m_fftSpectrum = Fft::kernelSpectrum(m_fftKernel, radius, paddedWidth, paddedHeight);
+        m_fftSpectrumOnGpu = false;
+    }
+    if (!uploadToGpu) return;
+
+    // Buffer dati: una griglia complessa per ogni coppia di canali
+    const int pairs = (getTextureFormatInfo(m_textureFormat).channels + 1) / 2;
+    const size_t elementCount = static_cast<size_t>(paddedWidth) * static_cast<size_t>(paddedHeight);
+    const size_t dataBytes = static_cast<size_t>(pairs) * elementCount * sizeof(Fft::Complex);
+    if (m_fftDataBuffer == 0 || dataBytes != m_fftDataBytes) {
+        if (m_fftDataBuffer == 0) glGenBuffers(1, &m_fftDataBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_fftDataBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(dataBytes), nullptr, GL_DYNAMIC_COPY);
+        m_fftDataBytes = dataBytes;
+    }
+    if (!m_fftSpectrumOnGpu) {
+        if (m_fftKernelBuffer == 0) glGenBuffers(1, &m_fftKernelBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_fftKernelBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(elementCount * sizeof(Fft::Complex)),
+                     m_fftSpectrum.data(), GL_STATIC_DRAW);
+        m_fftSpectrumOnGpu = true;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
 
-       glUniform2i(glGetUniformLocation(m_blurProgramID, "uImageSize"), m_width, m_height);
-       glUniform1f(glGetUniformLocation(m_blurProgramID, "uFade"), m_trailFade);
-       glUniform1f(glGetUniformLocation(m_blurProgramID, "uToneExposure"), m_toneExposure);
-       glUniform1f(glGetUniformLocation(m_blurProgramID, "uAutoDimThreshold"), m_autoDimThreshold);
-       glUniform1f(glGetUniformLocation(m_blurProgramID, "uAutoDimStrength"), m_autoDimStrength);
-       glUniform1f(glGetUniformLocation(m_blurProgramID, "uAutoDimGlobal"), m_autoDimGlobal);
+void SimulationGPU::runFftGpu(int radius)
+{
+    prepareFftSpectrum(radius, true);
+
+    const int pairs = (getTextureFormatInfo(m_textureFormat).channels + 1) / 2;
+    const int paddedWidth = m_fftPaddedWidth;
+    const int paddedHeight = m_fftPaddedHeight;
+    const int pairStride = paddedWidth * paddedHeight;
+    const GLuint paddedGroupsX = (paddedWidth + 15) / 16;
+    const GLuint paddedGroupsY = (paddedHeight + 15) / 16;
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, m_fftDataBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, m_fftKernelBuffer);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_textureIDIn);
 
-       GLint glFormat = GL_RGBA8;
-       if (m_textureFormat == TextureFormat::R8) glFormat = GL_R8;
-       else if (m_textureFormat == TextureFormat::RG8) glFormat = GL_RG8;
+    // 1. Pack con bordo avvolto
+    glUseProgram(m_fftPackProgramID);
+    glUniform2i(glGetUniformLocation(m_fftPackProgramID, "uFieldSize"), m_trailWidth, m_trailHeight);
+    glUniform2i(glGetUniformLocation(m_fftPackProgramID, "uPaddedSize"), paddedWidth, paddedHeight);
+    glUniform1i(glGetUniformLocation(m_fftPackProgramID, "uRadius"), radius);
+    m_passGraph.access({ PassGraph::texture(m_textureIDIn, PassGraph::Access::Sampled, 0),
+                         PassGraph::buffer(m_fftDataBuffer, PassGraph::Access::StorageWrite) });
+    glDispatchCompute(paddedGroupsX, paddedGroupsY, pairs);
+
+    // 2-4. Righe, colonne, spettro del kernel, colonne e righe inverse
+    auto transformLines = [&](bool rows, bool inverse) {
+        glUseProgram(m_fftProgramID);
+        glUniform1i(glGetUniformLocation(m_fftProgramID, "uLog2Length"), log2Int(rows ? paddedWidth : paddedHeight));
+        glUniform1i(glGetUniformLocation(m_fftProgramID, "uElementStride"), rows ? 1 : paddedWidth);
+        glUniform1i(glGetUniformLocation(m_fftProgramID, "uLineStride"), rows ? paddedWidth : 1);
+        glUniform1i(glGetUniformLocation(m_fftProgramID, "uPairStride"), pairStride);
+        glUniform1i(glGetUniformLocation(m_fftProgramID, "uInverse"), inverse ? 1 : 0);
+        m_passGraph.access({ PassGraph::buffer(m_fftDataBuffer, PassGraph::Access::StorageWrite) });
+        glDispatchCompute(rows ? paddedHeight : paddedWidth, 1, pairs);
+    };
+    transformLines(true, false);
+    transformLines(false, false);
+
+    glUseProgram(m_fftMultiplyProgramID);
+    glUniform2i(glGetUniformLocation(m_fftMultiplyProgramID, "uPaddedSize"), paddedWidth, paddedHeight);
+    m_passGraph.access({ PassGraph::buffer(m_fftDataBuffer, PassGraph::Access::StorageWrite),
+                         PassGraph::buffer(m_fftKernelBuffer, PassGraph::Access::StorageRead) });
+    glDispatchCompute(paddedGroupsX, paddedGroupsY, pairs);
+
+    transformLines(false, true);
+    transformLines(true, true);
+
+    // 5. Unpack della finestra centrale nella trail di output (fade e crescita Lenia opzionale)
+    glUseProgram(m_fftUnpackProgramID);
+    glUniform2i(glGetUniformLocation(m_fftUnpackProgramID, "uFieldSize"), m_trailWidth, m_trailHeight);
+    glUniform2i(glGetUniformLocation(m_fftUnpackProgramID, "uPaddedSize"), paddedWidth, paddedHeight);
+    glUniform1i(glGetUniformLocation(m_fftUnpackProgramID, "uRadius"), radius);
+    glUniform1i(glGetUniformLocation(m_fftUnpackProgramID, "uPairs"), pairs);
+    glUniform1f(glGetUniformLocation(m_fftUnpackProgramID, "uFade"), m_trailFade);
+    glUniform1i(glGetUniformLocation(m_fftUnpackProgramID, "uGrowth"), m_leniaGrowth ? 1 : 0);
+    glUniform1f(glGetUniformLocation(m_fftUnpackProgramID, "uGrowthMu"), m_leniaMu);
+    glUniform1f(glGetUniformLocation(m_fftUnpackProgramID, "uGrowthSigma"), m_leniaSigma);
+    glUniform1f(glGetUniformLocation(m_fftUnpackProgramID, "uGrowthDt"), m_leniaDt);
+    GLenum glFormat = getTextureFormatInfo(m_textureFormat).internalFormat;
+    glBindImageTexture(1, m_textureIDOut, 0, GL_FALSE, 0, GL_WRITE_ONLY, glFormat);
+    m_passGraph.access({ PassGraph::buffer(m_fftDataBuffer, PassGraph::Access::StorageRead),
+                         PassGraph::texture(m_textureIDIn, PassGraph::Access::Sampled, 0),
+                         PassGraph::texture(m_textureIDOut, PassGraph::Access::ImageWrite, 0) });
+    glDispatchCompute((m_trailWidth + 15) / 16, (m_trailHeight + 15) / 16, 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
 
-       glBindImageTexture(0, m_textureIDIn,  0, GL_FALSE, 0, GL_READ_ONLY,  glFormat);
-       glBindImageTexture(1, m_textureIDOut, 0, GL_FALSE, 0, GL_WRITE_ONLY, glFormat);
+void SimulationGPU::runFftCpu(int radius)
+{
+    prepareFftSpectrum(radius, false);
 
-       GLuint gx = (m_width  + 15) / 16;
-       GLuint gy = (m_height + 15) / 16;
-       glDispatchCompute(gx, gy, 1);
+    const int channels = getTextureFormatInfo(m_textureFormat).channels;
+    const size_t texelCount = static_cast<size_t>(m_trailWidth) * static_cast<size_t>(m_trailHeight);
+    m_fftCpuField.resize(texelCount * 4);
 
-       glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    // Readback (stallo voluto: e' il percorso di riferimento e di confronto)
+    m_passGraph.access({ PassGraph::texture(m_textureIDIn, PassGraph::Access::Transfer, 0) });
+    glBindTexture(GL_TEXTURE_2D, m_textureIDIn);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, m_fftCpuField.data());
+
+    std::vector<float> previous;
+    if (m_leniaGrowth) previous = m_fftCpuField;
+
+    Fft::convolveTorus(m_fftCpuField, m_trailWidth, m_trailHeight, channels, radius,
+                       m_fftSpectrum, m_fftPaddedWidth, m_fftPaddedHeight);
 
-       std::swap(m_textureIDIn, m_textureIDOut);
+    for (size_t i = 0; i < m_fftCpuField.size(); ++i) {
+        float value = m_fftCpuField[i];
+        if (m_leniaGrowth) {
+            float d = value - m_leniaMu;
+            float growth = 2.0f * std::exp(-(d * d) / (2.0f * m_leniaSigma * m_leniaSigma)) - 1.0f;
+            value = std::clamp(previous[i] + m_leniaDt * growth, 0.0f, 1.0f);
+        }
+        m_fftCpuField[i] = value * m_trailFade;
     }
-    
-    // 3. Blur Done
-    glQueryCounter(m_timeQueries[3], GL_TIMESTAMP);
-    
-    printPerformanceStats();
+
+    m_passGraph.access({ PassGraph::texture(m_textureIDOut, PassGraph::Access::Transfer, 0) });
+    glBindTexture(GL_TEXTURE_2D, m_textureIDOut);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_trailWidth, m_trailHeight, GL_RGBA, GL_FLOAT, m_fftCpuField.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+float SimulationGPU::measureDiffusionCost(DiffusionMode mode, int radius, int iterations)
+{
+    if (!m_initialized || iterations <= 0) return 0.0f;
+    if (mode == DiffusionMode::FftGpu && !isFftGpuAvailable(radius)) return -1.0f;
+
+    const DiffusionMode savedMode = m_diffusionMode;
+    const int savedRadius = m_diffusionRadius;
+    m_diffusionMode = mode;
+    m_diffusionRadius = radius;
+
+    // Warm-up: spettro del kernel e buffer fuori dalla misura
+    runBlurPass();
+    glFinish();
+
+    float ms = 0.0f;
+    if (mode == DiffusionMode::FftCpu) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; ++i) runBlurPass();
+        glFinish();
+        auto end = std::chrono::high_resolution_clock::now();
+        ms = std::chrono::duration<float, std::milli>(end - start).count();
+    } else {
+        glQueryCounter(m_diffusionQueries[0], GL_TIMESTAMP);
+        for (int i = 0; i < iterations; ++i) runBlurPass();
+        glQueryCounter(m_diffusionQueries[1], GL_TIMESTAMP);
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(m_diffusionQueries[0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(m_diffusionQueries[1], GL_QUERY_RESULT, &end);
+        ms = static_cast<float>((end - start) / 1000000.0);
+    }
+
+    m_passGraph.flush();
+    m_diffusionMode = savedMode;
+    m_diffusionRadius = savedRadius;
+    return ms / static_cast<float>(iterations);
 }
 
 // --------------------------------------------------
 void SimulationGPU::createComputeShaders()
 {
-    std::string defines = "";
-    if (m_textureFormat == TextureFormat::R8) defines = "#define FORMAT_R8";
-    else if (m_textureFormat == TextureFormat::RG8) defines = "#define FORMAT_RG8";
-    else defines = "#define FORMAT_RGBA8";
+    // Record delle particelle generati da ParticleLayout.h per il layout corrente
+    std::string particleDefines = Particles::glslDefinitions(m_particleLayout);
 
-    // update.comp
-    {
-        std::string compSource = readFile("shaders/update.comp");
-        GLuint compShader = compileShader(compSource, GL_COMPUTE_SHADER, defines);
-
-        m_updateProgramID = glCreateProgram();
-        glAttachShader(m_updateProgramID, compShader);
-        glLinkProgram(m_updateProgramID);
-
-        GLint success;
-        glGetProgramiv(m_updateProgramID, GL_LINK_STATUS, &success);
-        if (!success) {
-            char infoLog[512];
-            glGetProgramInfoLog(m_updateProgramID, 512, nullptr, infoLog);
-            throw std::runtime_error("Update shader link error:\n" + std::string(infoLog));
-        }
-        glDeleteShader(compShader);
+    // Tutti avviati prima di verificarne uno (vedi ProgramBatch)
+    ProgramBatch batch;
+
+    // reaction.comp (Gray-Scott, formato del campo fisso)
+    batch.add(m_reactionProgramID, "shaders/reaction.comp", "Reaction");
+
+    // Convoluzione FFT (formato gestito da sampler / image senza qualificatore)
+    batch.add(m_fftPackProgramID, "shaders/fft_pack.comp", "FFT Pack");
+    batch.add(m_fftProgramID, "shaders/fft.comp", "FFT");
+    batch.add(m_fftMultiplyProgramID, "shaders/fft_multiply.comp", "FFT Multiply");
+    batch.add(m_fftUnpackProgramID, "shaders/fft_unpack.comp", "FFT Unpack");
+
+    // Densita' a zone (contatori + summed-area table)
+    batch.add(m_zoneCountProgramID, "shaders/zone_count.comp", "Zone Count", particleDefines);
+    batch.add(m_zoneSatProgramID, "shaders/zone_sat.comp", "Zone SAT");
+
+    // Metriche di attivita' per lo stato stazionario
+    batch.add(m_activityProgramID, "shaders/activity.comp", "Activity", particleDefines);
+
+    // Modalita' deterministica (costanti da DeterministicSimulation.h)
+    batch.add(m_detUpdateProgramID, "shaders/det_update.comp", "Deterministic Update", Deterministic::glslDefinitions());
+
+    // Semina delle particelle (ramp-up, reset, cambio di seme)
+    batch.add(m_seedProgramID, "shaders/seed.comp", "Seed", particleDefines);
+
+    // Emettitori: compattazione delle vive ed emissione delle nuove
+    batch.add(m_compactProgramID, "shaders/compact.comp", "Compact", particleDefines);
+    batch.add(m_emitProgramID, "shaders/emit.comp", "Emit", particleDefines);
+
+    // Riscalatura delle posizioni nel resize, riassegnazione delle specie
+    batch.add(m_rescaleProgramID, "shaders/rescale.comp", "Rescale", particleDefines);
+    batch.add(m_speciesProgramID, "shaders/species.comp", "Species", particleDefines);
+
+    // Griglia spaziale
+    batch.add(m_gridResetProgramID, "shaders/grid_reset.comp", "Grid Reset");
+    batch.add(m_gridBuildProgramID, "shaders/grid_build.comp", "Grid Build", particleDefines);
+
+    // update.comp, blur.comp, trail_mip.comp, det_trail.comp: dalla cache per formato (compilati
+    // mentre il driver lavora ancora su quelli sopra)
+    selectFormatPrograms();
+    batch.finish();
+}
+
+void SimulationGPU::setSpeciesSettings(int species, const SpeciesSettings& settings)
+{
+    if (species < 0 || species >= kSpeciesCount) return;
+    SpeciesSettings& target = m_speciesSettings[species];
+    target.sensorScale = std::clamp(settings.sensorScale, 0.1f, 8.0f);
+    target.sensorAngleScale = std::clamp(settings.sensorAngleScale, 0.1f, 4.0f);
+    target.turnScale = std::clamp(settings.turnScale, 0.0f, 4.0f);
+    target.speedScale = std::clamp(settings.speedScale, 0.1f, 4.0f);
+    target.depositScale = std::clamp(settings.depositScale, 0.0f, 8.0f);
+    target.alignmentScale = std::clamp(settings.alignmentScale, 0.0f, 4.0f);
+    target.separationScale = std::clamp(settings.separationScale, 0.0f, 4.0f);
+    target.cohesionScale = std::clamp(settings.cohesionScale, 0.0f, 4.0f);
+    target.hueShift = settings.hueShift - std::floor(settings.hueShift);
+}
+
+void SimulationGPU::uploadSpeciesTable()
+{
+    // Riga std430 di SpeciesParams (update.comp): sensor, motion, boids
+    float table[kSpeciesCount][12] = {};
+    for (int s = 0; s < kSpeciesCount; ++s) {
+        const SpeciesSettings& settings = m_speciesSettings[s];
+        const float sensorAngle = m_sensorAngle * settings.sensorAngleScale;
+        float* row = table[s];
+        row[0] = m_sensorDistance * settings.sensorScale;
+        row[1] = std::cos(sensorAngle);
+        row[2] = std::sin(sensorAngle);
+        row[3] = m_turnAngle * settings.turnScale;
+        row[4] = m_speed * settings.speedScale;
+        row[5] = 0.05f * m_physarumIntensity * settings.depositScale;
+        row[6] = settings.hueShift;
+        row[8] = m_alignmentWeight * settings.alignmentScale;
+        row[9] = m_separationWeight * settings.separationScale;
+        row[10] = m_cohesionWeight * settings.cohesionScale;
     }
+    if (m_speciesTableValid && std::memcmp(table, m_speciesTable, sizeof(table)) == 0) return;
 
-    // blur.comp
-    {
-        std::string compSource = readFile("shaders/blur.comp");
-        GLuint compShader = compileShader(compSource, GL_COMPUTE_SHADER, defines);
-
-        m_blurProgramID = glCreateProgram();
-        glAttachShader(m_blurProgramID, compShader);
-        glLinkProgram(m_blurProgramID);
-
-        GLint success;
-        glGetProgramiv(m_blurProgramID, GL_LINK_STATUS, &success);
-        if (!success) {
-            char infoLog[512];
-            glGetProgramInfoLog(m_blurProgramID, 512, nullptr, infoLog);
-            throw std::runtime_error("Blur shader link error:\n" + std::string(infoLog));
+    std::memcpy(m_speciesTable, table, sizeof(table));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_speciesTableBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(m_speciesTable), m_speciesTable);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    m_speciesTableValid = true;
+}
+
+void SimulationGPU::uploadUpdateParams(float dt, float mouseX, float mouseY, bool mousePressed, int mouseMode,
+                                       bool samplerSensing, bool reactionEnabled)
+{
+    static_assert(sizeof(UpdateSimParams) % 16 == 0 && sizeof(UpdateStepParams) % 16 == 0, "blocchi std140");
+
+    UpdateSimParams p = {};
+    std::copy(m_color1, m_color1 + 3, p.color1);
+    std::copy(m_color2, m_color2 + 3, p.color2);
+    p.colorOffset = m_colorOffset;
+    p.colorSource = m_colorSource == 0 ? 0 : 1;
+    for (int s = 0; s < kSpeciesCount; ++s) {
+        p.zoneSpeciesForce[s][0] = m_speciesZoneForce[s][0];
+        p.zoneSpeciesForce[s][1] = m_speciesZoneForce[s][1];
+    }
+    p.simSize[0] = static_cast<float>(m_width);
+    p.simSize[1] = static_cast<float>(m_height);
+    p.trailScale[0] = static_cast<float>(m_trailWidth) / static_cast<float>(m_width);
+    p.trailScale[1] = static_cast<float>(m_trailHeight) / static_cast<float>(m_height);
+    p.trailSize[0] = m_trailWidth;
+    p.trailSize[1] = m_trailHeight;
+    p.boundaryMode = m_boundaryMode;
+    p.physarumEnabled = m_physarumEnabled ? 1 : 0;
+    p.physarumIntensity = m_physarumIntensity;
+    p.reactionEnabled = reactionEnabled ? 1 : 0;
+    p.reactionDeposit = m_reactionDeposit;
+    p.reactionSenseWeight = m_reactionSenseWeight;
+    p.speciesChannels = isSpeciesChannelsActive() ? 1 : 0;
+    p.samplerSensing = samplerSensing ? 1 : 0;
+    p.pyramidEnabled = (m_trailPyramidEnabled && m_trailLevels > 1) ? 1 : 0;
+    p.pyramidBaseDistance = m_pyramidBaseDistance;
+    p.pyramidMaxLod = static_cast<float>(m_trailLevels - 1);
+    p.speedMin = m_speedMin;
+    p.speedMax = m_speedMax;
+    p.inertia = m_inertia;
+    p.restitution = m_restitution;
+    p.randomWeight = m_randomWeight;
+
+    float effectiveMin = m_colorSpeedMin;
+    float effectiveMax = m_colorSpeedMax;
+    if (m_colorSource == 2 && m_autoSpeedValid) {
+        effectiveMin = m_autoSpeedMin;
+        effectiveMax = m_autoSpeedMax;
+    }
+    if (effectiveMax <= effectiveMin) {
+        effectiveMax = effectiveMin + 1.0f;
+    }
+    p.colorSpeedMin = effectiveMin;
+    p.colorSpeedMax = effectiveMax;
+
+    p.collisionsEnabled = m_collisionsEnabled ? 1 : 0;
+    p.collisionRadius = m_collisionRadius;
+    p.boidsEnabled = m_boidsEnabled ? 1 : 0;
+    if (m_boidsEnabled || m_collisionsEnabled) {
+        p.boidsRadius = m_boidsRadius;
+        p.cellSize = m_cellSize;
+        p.gridWidth = m_gridWidth;
+        p.gridHeight = m_gridHeight;
+    }
+
+    p.zoneForcesEnabled = m_zoneForcesEnabled ? 1 : 0;
+    if (m_zoneForcesEnabled) {
+        // La zona (2R+1 celle) non puo' superare la griglia: le query avvolgono un solo bordo per asse
+        int maxRadius = std::max(0, (std::min(m_zoneGridWidth, m_zoneGridHeight) - 1) / 2);
+        p.zoneGridSize[0] = m_zoneGridWidth;
+        p.zoneGridSize[1] = m_zoneGridHeight;
+        p.zoneCellSize = m_zoneCellSize;
+        p.zoneRadius = std::min(m_zoneRadius, maxRadius);
+        p.zoneStrength = m_zoneStrength;
+    }
+
+    p.mouseFalloff = m_mouseFalloff;
+    p.mouseStrength = m_mouseStrength;
+    p.mouseGaussianSigma = m_mouseGaussianSigma;
+    p.mouseOscFreq = m_mouseOscFreq;
+    p.mouseRingOverlay = m_mouseRingOverlay ? 1 : 0;
+    p.mouseRingRadius = m_mouseRingRadius;
+
+    if (!m_simParamsValid || std::memcmp(&p, &m_simParams, sizeof(p)) != 0) {
+        m_simParams = p;
+        glBindBuffer(GL_UNIFORM_BUFFER, m_simParamsUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(m_simParams), &m_simParams);
+        m_simParamsValid = true;
+    }
+
+    UpdateStepParams step = {};
+    step.mousePos[0] = mouseX;
+    step.mousePos[1] = mouseY;
+    step.dt = dt;
+    step.mousePressed = mousePressed ? 1 : 0;
+    step.mouseMode = mouseMode;
+    if (!m_stepParamsValid || std::memcmp(&step, &m_stepParams, sizeof(step)) != 0) {
+        m_stepParams = step;
+        glBindBuffer(GL_UNIFORM_BUFFER, m_stepParamsUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(m_stepParams), &m_stepParams);
+        m_stepParamsValid = true;
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void SimulationGPU::assignSpecies()
+{
+    // In place sul buffer corrente come rescaleParticles; con gli emettitori la compattazione successiva
+    // ordina comunque per specie
+    glUseProgram(m_speciesProgramID);
+    bindParticleStreams(m_currentBuffer, false);
+    bindParticleStreams(m_currentBuffer, true);
+    glUniform1i(glGetUniformLocation(m_speciesProgramID, "uSpeciesCount"), m_speciesCount);
+    dispatchParticles(m_activeParticles, 256);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    m_speciesAssigned = m_speciesCount;
+}
+
+const SimulationGPU::FormatPrograms& SimulationGPU::formatPrograms(TextureFormat format)
+{
+    FormatPrograms& programs = m_formatPrograms[static_cast<int>(format)];
+    const std::string defines = getTextureFormatInfo(format).shaderDefine;
+    ProgramBatch batch;
+    if (!programs.update) {
+        batch.add(programs.update, "shaders/update.comp", "Update",
+                  defines + "\n" + Particles::glslDefinitions(m_particleLayout));
+    }
+    if (!programs.blur) batch.add(programs.blur, "shaders/blur.comp", "Blur", defines);
+    // Riduzione 2x2 di un livello della trail nel successivo
+    if (!programs.mip) batch.add(programs.mip, "shaders/trail_mip.comp", "Trail Mip", defines);
+    if (!programs.detTrail) {
+        batch.add(programs.detTrail, "shaders/det_trail.comp", "Deterministic Trail",
+                  defines + "\n" + Deterministic::glslDefinitions());
+    }
+    if (!programs.resample) batch.add(programs.resample, "shaders/resample.comp", "Resample", defines);
+    batch.finish();
+    return programs;
+}
+
+void SimulationGPU::selectFormatPrograms()
+{
+    const FormatPrograms& programs = formatPrograms(m_textureFormat);
+    m_updateProgramID = programs.update;
+    m_blurProgramID = programs.blur;
+    m_mipProgramID = programs.mip;
+    m_detTrailProgramID = programs.detTrail;
+}
+
+void SimulationGPU::releaseFormatPrograms(bool layoutOnly)
+{
+    for (FormatPrograms& programs : m_formatPrograms) {
+        GLuint* ids[] = { &programs.update, &programs.blur, &programs.mip, &programs.detTrail, &programs.resample };
+        for (GLuint* id : ids) {
+            if (*id && (!layoutOnly || id == &programs.update)) { glDeleteProgram(*id); *id = 0; }
         }
-        glDeleteShader(compShader);
     }
+    for (auto& entry : m_updateVariants) glDeleteProgram(entry.second.pending.program);
+    m_updateVariants.clear();
+    m_updateVariantActive = false;
+    m_updateProgramID = 0;
+    if (!layoutOnly) m_blurProgramID = m_mipProgramID = m_detTrailProgramID = 0;
+}
 
-    // grid_reset.comp
-    {
-        std::string compSource = readFile("shaders/grid_reset.comp");
-        GLuint compShader = compileShader(compSource, GL_COMPUTE_SHADER);
-
-        m_gridResetProgramID = glCreateProgram();
-        glAttachShader(m_gridResetProgramID, compShader);
-        glLinkProgram(m_gridResetProgramID);
-
-        GLint success;
-        glGetProgramiv(m_gridResetProgramID, GL_LINK_STATUS, &success);
-        if (!success) {
-            char infoLog[512];
-            glGetProgramInfoLog(m_gridResetProgramID, 512, nullptr, infoLog);
-            throw std::runtime_error("Grid Reset shader link error:\n" + std::string(infoLog));
+uint32_t SimulationGPU::updateVariantKey(bool samplerSensing, bool reactionEnabled, int mouseMode) const
+{
+    // Stessi valori che uploadUpdateParams scrive in SimParams / StepParams
+    uint32_t key = static_cast<uint32_t>(m_boundaryMode) & 3u;
+    key |= (static_cast<uint32_t>(m_mouseFalloff) & 7u) << 2;
+    key |= (static_cast<uint32_t>(mouseMode) & 3u) << 5;
+    key |= (m_colorSource == 0 ? 0u : 1u) << 7;
+    key |= (m_physarumEnabled ? 1u : 0u) << 8;
+    key |= (m_boidsEnabled ? 1u : 0u) << 9;
+    key |= (m_collisionsEnabled ? 1u : 0u) << 10;
+    key |= (m_zoneForcesEnabled ? 1u : 0u) << 11;
+    key |= (reactionEnabled ? 1u : 0u) << 12;
+    key |= (isSpeciesChannelsActive() ? 1u : 0u) << 13;
+    key |= (samplerSensing ? 1u : 0u) << 14;
+    key |= ((m_trailPyramidEnabled && m_trailLevels > 1) ? 1u : 0u) << 15;
+    key |= static_cast<uint32_t>(m_textureFormat) << 16;
+    return key;
+}
+
+std::string SimulationGPU::updateVariantDefines(uint32_t key) const
+{
+    auto field = [key](const char* name, int shift, uint32_t mask) {
+        return std::string("#define ") + name + " " + std::to_string((key >> shift) & mask) + "\n";
+    };
+    const TextureFormat format = static_cast<TextureFormat>(key >> 16);
+    return std::string(getTextureFormatInfo(format).shaderDefine) + "\n"
+           "#define UPDATE_VARIANT\n"
+           + field("VARIANT_BOUNDARY_MODE", 0, 3u)
+           + field("VARIANT_MOUSE_FALLOFF", 2, 7u)
+           + field("VARIANT_MOUSE_MODE", 5, 3u)
+           + field("VARIANT_COLOR_SOURCE", 7, 1u)
+           + field("VARIANT_PHYSARUM", 8, 1u)
+           + field("VARIANT_BOIDS", 9, 1u)
+           + field("VARIANT_COLLISIONS", 10, 1u)
+           + field("VARIANT_ZONE_FORCES", 11, 1u)
+           + field("VARIANT_REACTION", 12, 1u)
+           + field("VARIANT_SPECIES_CHANNELS", 13, 1u)
+           + field("VARIANT_SAMPLER_SENSING", 14, 1u)
+           + field("VARIANT_PYRAMID", 15, 1u)
+           + Particles::glslDefinitions(m_particleLayout);
+}
+
+void SimulationGPU::pollUpdateVariants()
+{
+    for (auto& entry : m_updateVariants) {
+        UpdateVariant& variant = entry.second;
+        if (variant.ready || variant.failed) continue;
+        // Senza l'estensione lo stato si legge dopo qualche passo: il driver ha avuto tempo di finire
+        const bool done = ProgramCache::isComplete(variant.pending) ||
+                          (!m_parallelShaderCompile && ++variant.waitSteps >= kVariantWaitSteps);
+        if (!done) continue;
+        try {
+            ProgramCache::finish(variant.pending);
+            variant.ready = true;
+        } catch (const std::exception& e) {
+            // Resta il programma generico del formato
+            std::cout << "[Shader] " << e.what() << std::endl;
+            variant.failed = true;
         }
-        glDeleteShader(compShader);
     }
+}
 
-    // grid_build.comp
-    {
-        std::string compSource = readFile("shaders/grid_build.comp");
-        GLuint compShader = compileShader(compSource, GL_COMPUTE_SHADER);
-
-        m_gridBuildProgramID = glCreateProgram();
-        glAttachShader(m_gridBuildProgramID, compShader);
-        glLinkProgram(m_gridBuildProgramID);
-
-        GLint success;
-        glGetProgramiv(m_gridBuildProgramID, GL_LINK_STATUS, &success);
-        if (!success) {
-            char infoLog[512];
-            glGetProgramInfoLog(m_gridBuildProgramID, 512, nullptr, infoLog);
-            throw std::runtime_error("Grid Build shader link error:\n" + std::string(infoLog));
+GLuint SimulationGPU::selectUpdateProgram(bool samplerSensing, bool reactionEnabled, int mouseMode)
+{
+    m_updateVariantActive = false;
+    if (!m_shaderVariantsEnabled) return m_updateProgramID;
+
+    const uint32_t key = updateVariantKey(samplerSensing, reactionEnabled, mouseMode);
+    auto it = m_updateVariants.find(key);
+    if (it == m_updateVariants.end()) {
+        if (static_cast<int>(m_updateVariants.size()) >= kMaxUpdateVariants) {
+            auto oldest = m_updateVariants.begin();
+            for (auto candidate = m_updateVariants.begin(); candidate != m_updateVariants.end(); ++candidate) {
+                if (candidate->second.lastUsed < oldest->second.lastUsed) oldest = candidate;
+            }
+            glDeleteProgram(oldest->second.pending.program);
+            m_updateVariants.erase(oldest);
         }
-        glDeleteShader(compShader);
+        UpdateVariant variant;
+        variant.pending = startComputeProgram("shaders/update.comp", "Update variant", updateVariantDefines(key));
+        it = m_updateVariants.emplace(key, variant).first;
     }
+    // Dopo l'avvio: una variante caricata dalla cache dei binari e' utilizzabile gia' in questo passo
+    pollUpdateVariants();
+    it->second.lastUsed = ++m_updateVariantClock;
+    if (!it->second.ready) return m_updateProgramID;
+    m_updateVariantActive = true;
+    return it->second.pending.program;
+}
+
+void SimulationGPU::resampleTexture(GLuint source, GLuint dest, int width, int height, TextureFormat format)
+{
+    GLuint program = formatPrograms(format).resample;
+    glUseProgram(program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source);
+    glBindSampler(0, 0);   // filtro lineare e wrap della texture sorgente
+    glBindImageTexture(1, dest, 0, GL_FALSE, 0, GL_WRITE_ONLY, getTextureFormatInfo(format).internalFormat);
+    glUniform2i(glGetUniformLocation(program, "uDestSize"), width, height);
+    glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void SimulationGPU::rescaleParticles(float scaleX, float scaleY)
+{
+    // Un record letto e riscritto dallo stesso thread: in place sul buffer corrente. L'eventuale secondo
+    // buffer viene riscritto per intero dal prossimo update.
+    glUseProgram(m_rescaleProgramID);
+    bindParticleStreams(m_currentBuffer, false);
+    bindParticleStreams(m_currentBuffer, true);
+    glUniform2f(glGetUniformLocation(m_rescaleProgramID, "uScale"), scaleX, scaleY);
+    glUniform2f(glGetUniformLocation(m_rescaleProgramID, "uSimSize"), (float)m_width, (float)m_height);
+    dispatchParticles(m_activeParticles, 256);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 }
 
 void SimulationGPU::createTextures()
 {
-    GLint internalFormat = GL_RGBA8;
-    GLenum format = GL_RGBA;
+    const TextureFormatInfo& info = getTextureFormatInfo(m_textureFormat);
+    GLenum internalFormat = info.internalFormat;
+
+    // Catena mip completa fino a kMaxTrailLevels (i livelli > 0 servono solo al sensing multi-scala)
+    m_trailLevels = 1;
+    while (m_trailLevels < kMaxTrailLevels &&
+           (std::max(m_trailWidth, m_trailHeight) >> m_trailLevels) >= 1) {
+        ++m_trailLevels;
+    }
 
-    if (m_textureFormat == TextureFormat::R8) {
-        internalFormat = GL_R8;
-        format = GL_RED;
-    } else if (m_textureFormat == TextureFormat::RG8) {
-        internalFormat = GL_RG8;
-        format = GL_RG;
+    // Creiamo due texture (storage immutabile con i livelli mip)
+    GLuint textures[2];
+    glGenTextures(2, textures);
+    for (GLuint tex : textures)
+    {
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexStorage2D(GL_TEXTURE_2D, m_trailLevels, internalFormat, m_trailWidth, m_trailHeight);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // Il pass finale legge solo il livello 0; il sensing usa m_trailLodSampler
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        // glTexStorage non inizializza il contenuto
+        const float zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (int level = 0; level < m_trailLevels; ++level) {
+            glClearTexImage(tex, level, GL_RGBA, GL_FLOAT, zero);
+        }
     }
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    // Creiamo due texture
-    glGenTextures(1, &m_textureIDIn);
-    glBindTexture(GL_TEXTURE_2D, m_textureIDIn);
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, m_width, m_height, 0,
-                 format, GL_UNSIGNED_BYTE, nullptr);
+    m_textureIDIn = textures[0];
+    // Seconda texture per ping-pong
+    m_textureIDOut = textures[1];
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    createReactionField();
+}
 
+void SimulationGPU::createReactionField()
+{
+    GLuint textures[2];
+    glGenTextures(2, textures);
+    for (GLuint tex : textures)
+    {
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, m_trailWidth, m_trailHeight);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
     glBindTexture(GL_TEXTURE_2D, 0);
 
-    // Seconda texture per ping-pong
-    glGenTextures(1, &m_textureIDOut);
-    glBindTexture(GL_TEXTURE_2D, m_textureIDOut);
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, m_width, m_height, 0,
-                 format, GL_UNSIGNED_BYTE, nullptr);
+    m_fieldIDIn = textures[0];
+    m_fieldIDOut = textures[1];
+    resetReactionField();
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+void SimulationGPU::resetReactionField()
+{
+    // Stato omogeneo U = 1, V = 0: i pattern nascono dal feed depositato dalle particelle
+    const float rest[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+    glClearTexImage(m_fieldIDIn, 0, GL_RGBA, GL_FLOAT, rest);
+    glClearTexImage(m_fieldIDOut, 0, GL_RGBA, GL_FLOAT, rest);
+}
 
+void SimulationGPU::buildTrailPyramid()
+{
+    glUseProgram(m_mipProgramID);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_textureIDIn);
+    // Il sampler mipmap rende leggibili via texelFetch anche i livelli > 0
+    glBindSampler(0, m_trailLodSampler);
+
+    const GLenum glFormat = getTextureFormatInfo(m_textureFormat).internalFormat;
+    int w = m_trailWidth, h = m_trailHeight;
+    for (int level = 1; level < m_trailLevels; ++level)
+    {
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+        glUniform1i(glGetUniformLocation(m_mipProgramID, "uSourceLevel"), level - 1);
+        glUniform2i(glGetUniformLocation(m_mipProgramID, "uDestSize"), w, h);
+        glBindImageTexture(0, m_textureIDIn, level, GL_FALSE, 0, GL_WRITE_ONLY, glFormat);
+
+        // Il livello appena scritto e' la sorgente (texelFetch) del successivo; il livello 0 viene
+        // dall'image store del blur: serve la barriera di texture fetch, non solo quella di image access
+        m_passGraph.access({ PassGraph::texture(m_textureIDIn, PassGraph::Access::Sampled, level - 1),
+                             PassGraph::texture(m_textureIDIn, PassGraph::Access::ImageWrite, level) });
+        glDispatchCompute((w + 15) / 16, (h + 15) / 16, 1);
+    }
+    glBindSampler(0, 0);
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+void SimulationGPU::setTrailPyramidEnabled(bool enabled)
+{
+    if (enabled == m_trailPyramidEnabled) return;
+    m_trailPyramidEnabled = enabled;
+    // Finche' era spenta i livelli > 0 non sono stati aggiornati: senza ricostruirli il prossimo update
+    // leggerebbe texel vecchi (o zero)
+    if (enabled && m_mipProgramID && m_trailLevels > 1) {
+        buildTrailPyramid();
+        m_passGraph.flush();
+    }
+}
+
 void SimulationGPU::initializeParticles()
 {
-    std::vector<GpuParticle> particles(m_maxParticles);
-    for (int i = 0; i < m_maxParticles; ++i)
-    {
-        // Initialize to 0,0 or center, doesn't matter much as they are inactive
-        particles[i].position[0] = m_width * 0.5f;
-        particles[i].position[1] = m_height * 0.5f;
-        particles[i].angle = 0.0f;
-        particles[i].speed = m_speedMin;
-        particles[i].species = static_cast<float>(rand() % 3);
-        particles[i]._pad[0] = 0; particles[i]._pad[1] = 0; particles[i]._pad[2] = 0;
-    }
-
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_particleBuffers[0]);
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
-                    particles.size() * sizeof(GpuParticle),
-                    particles.data());
+    // Tutto il buffer in GPU: le particelle inattive restano al centro finche' il ramp-up non le risemina
+    seedParticles(0, m_maxParticles, SeedDistribution::CenterBurst);
+    m_speciesAssigned = m_speciesCount;
+}
+
+void SimulationGPU::seedParticles(int start, int count, SeedDistribution distribution)
+{
+    count = std::min(count, m_maxParticles - start);
+    if (count <= 0 || !m_seedProgramID) return;
+
+    const float minSide = static_cast<float>(std::min(m_width, m_height));
+    glUseProgram(m_seedProgramID);
+    glUniform1i(glGetUniformLocation(m_seedProgramID, "uDistribution"), static_cast<int>(distribution));
+    glUniform2f(glGetUniformLocation(m_seedProgramID, "uSimSize"), static_cast<float>(m_width), static_cast<float>(m_height));
+    glUniform1f(glGetUniformLocation(m_seedProgramID, "uBurstRadius"), std::min(10.0f, 0.5f * minSide));
+    glUniform1f(glGetUniformLocation(m_seedProgramID, "uRingRadius"), 0.35f * minSide);
+    glUniform1f(glGetUniformLocation(m_seedProgramID, "uSpeedMin"), m_speedMin);
+    glUniform1f(glGetUniformLocation(m_seedProgramID, "uSpeedMax"), m_speedMax);
+    glUniform1ui(glGetUniformLocation(m_seedProgramID, "uRandomSeed"), m_randomSeed);
+    glUniform1ui(glGetUniformLocation(m_seedProgramID, "uSeedBatch"), pcgHash(m_randomSeed ^ pcgHash(m_seedBatch++)));
+    glUniform1i(glGetUniformLocation(m_seedProgramID, "uImageTries"), 16);
+    glUniform1i(glGetUniformLocation(m_seedProgramID, "uSpeciesCount"), m_speciesCount);
+
+    if (distribution == SeedDistribution::Image) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, m_seedImageTexture ? m_seedImageTexture : m_textureIDIn);
+        glBindSampler(0, 0);
+        // La trail appena scritta dall'image store del blur
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    // Una scrittura per buffer: con il double buffering anche il secondo deve partire dallo stesso stato.
+    // A blocchi per restare sotto il limite di 65535 gruppi per dispatch.
+    const int maxPerDispatch = 65535 * 256;
+    for (int buffer = 0; buffer < 2; ++buffer) {
+        if (!m_particleBuffers[buffer]) continue;
+        bindParticleStreams(buffer, true);
+        for (int offset = 0; offset < count; offset += maxPerDispatch) {
+            int batch = std::min(maxPerDispatch, count - offset);
+            glUniform1i(glGetUniformLocation(m_seedProgramID, "uStart"), start + offset);
+            glUniform1i(glGetUniformLocation(m_seedProgramID, "uCount"), batch);
+            glDispatchCompute((batch + 255) / 256, 1, 1);
+        }
+    }
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    if (distribution == SeedDistribution::Image) glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+}
+
+void SimulationGPU::setSeedImage(const std::vector<uint8_t>& luminance, int width, int height)
+{
+    if (m_seedImageTexture) { glDeleteTextures(1, &m_seedImageTexture); m_seedImageTexture = 0; }
+    if (luminance.empty() || width <= 0 || height <= 0) return;
+    if (luminance.size() < static_cast<size_t>(width) * static_cast<size_t>(height)) {
+        throw std::runtime_error("Seed image: " + std::to_string(luminance.size()) + " bytes for " +
+                                 std::to_string(width) + "x" + std::to_string(height));
+    }
+
+    glGenTextures(1, &m_seedImageTexture);
+    glBindTexture(GL_TEXTURE_2D, m_seedImageTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, width, height);
+    // La y della simulazione cresce verso l'alto (t = 0 in basso): righe capovolte, la prima finisce in alto
+    const size_t rowBytes = static_cast<size_t>(width);
+    std::vector<uint8_t> rows(rowBytes * static_cast<size_t>(height));
+    for (int y = 0; y < height; ++y) {
+        std::copy_n(luminance.begin() + static_cast<size_t>(y) * rowBytes, rowBytes,
+                    rows.begin() + static_cast<size_t>(height - 1 - y) * rowBytes);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, rows.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+size_t SimulationGPU::estimateFieldMemoryBytes(int width, int height, TextureFormat format, int trailDivisor)
+{
+    trailDivisor = std::max(1, trailDivisor);
+    const size_t trailWidth = static_cast<size_t>(std::max(1, (width + trailDivisor - 1) / trailDivisor));
+    const size_t trailHeight = static_cast<size_t>(std::max(1, (height + trailDivisor - 1) / trailDivisor));
+
+    // Trail: due texture con la catena mip completa (stesso conteggio di createTextures)
+    size_t texels = 0;
+    size_t w = trailWidth, h = trailHeight;
+    for (int level = 0; level < kMaxTrailLevels; ++level) {
+        texels += w * h;
+        if (std::max(w, h) == 1) break;
+        w = std::max<size_t>(1, w / 2);
+        h = std::max<size_t>(1, h / 2);
+    }
+    size_t bytes = 2 * texels * static_cast<size_t>(getTextureFormatInfo(format).bytesPerTexel);
+
+    // Campo Gray-Scott (RGBA16F ping-pong), teste della griglia alla cella minima (10 px), tile di attivita'
+    bytes += 2 * trailWidth * trailHeight * 8;
+    bytes += static_cast<size_t>((width + 9) / 10) * static_cast<size_t>((height + 9) / 10) * sizeof(GLint);
+    bytes += ((trailWidth + 15) / 16) * ((trailHeight + 15) / 16) * 2 * sizeof(float);
+    return bytes;
+}
+
+int SimulationGPU::planParticleCapacity(uint64_t budgetBytes, int width, int height, TextureFormat format, int trailDivisor)
+{
+    const uint64_t fieldBytes = estimateFieldMemoryBytes(width, height, format, trailDivisor);
+    const uint64_t perParticle = 2 * sizeof(GpuParticle) + sizeof(GLint);
+    const uint64_t available = (budgetBytes > fieldBytes) ? budgetBytes - fieldBytes : 0;
+    return static_cast<int>(std::min<uint64_t>(available / perParticle, kMaxParticleCapacity));
+}
+
+// --------------------------------------------------
+// Emettitori e durata di vita
+
+void SimulationGPU::setEmittersEnabled(bool enabled)
+{
+    if (enabled == m_emittersEnabled) return;
+    m_emittersEnabled = enabled;
+    releaseEmitterBuffers();
+    // Accesi: si riparte da zero particelle vive. Spenti: il ramp-up risemina tutto il tetto.
+    m_activeParticles = enabled ? m_targetParticles : 0;
+}
+
+void SimulationGPU::setEmitters(const std::vector<ParticleEmitter>& emitters)
+{
+    const size_t count = std::min(emitters.size(), static_cast<size_t>(kMaxEmitters));
+    m_emitters.assign(emitters.begin(), emitters.begin() + count);
+    m_emitterCarry.resize(count, 0.0f);
+}
+
+void SimulationGPU::releaseEmitterBuffers()
+{
+    GLuint* buffers[] = { &m_particleLifeBuffers[0], &m_particleLifeBuffers[1], &m_particleCountBuffer,
+                          &m_compactGroupBuffer, &m_emitterBuffer };
+    for (GLuint* buffer : buffers) {
+        if (*buffer) { glDeleteBuffers(1, buffer); *buffer = 0; }
+    }
+    m_emittersReady = false;
+}
+
+void SimulationGPU::runEmitters(float dt)
+{
+    // Record di un emettitore nella tabella di emit.comp (std430)
+    struct GpuEmitter {
+        float    area[4];
+        float    motion[4];
+        uint32_t range[4];
+    };
+
+    if (!m_emittersReady) {
+        releaseEmitterBuffers();
+        glGenBuffers(2, m_particleLifeBuffers);
+        for (GLuint buffer : m_particleLifeBuffers) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<size_t>(m_maxParticles) * 2 * sizeof(float), nullptr, GL_DYNAMIC_COPY);
+        }
+        // Corrente e pending a zero particelle (dispatch indiretto di 0 x 1 x 1 gruppi)
+        const GpuParticleCount empty = { {0u, 1u, 1u}, {0u, 1u, 1u}, 0u, 0u };
+        const GpuParticleCount counts[2] = { empty, empty };
+        glGenBuffers(1, &m_particleCountBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_particleCountBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(counts), counts, GL_DYNAMIC_COPY);
+        glGenBuffers(1, &m_compactGroupBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_compactGroupBuffer);
+        // Un uvec4 per workgroup: conteggi (poi offset) per specie
+        glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<size_t>(m_maxParticles / 256 + 1) * 4 * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+        glGenBuffers(1, &m_emitterBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_emitterBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, kMaxEmitters * sizeof(GpuEmitter), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        std::fill(m_emitterCarry.begin(), m_emitterCarry.end(), 0.0f);
+        m_emittedTotal = 0u;
+        m_emittersReady = true;
+    }
+    // La compattazione scrive nell'altro buffer: senza (memoria esaurita) la popolazione resta ferma
+    if (!m_particleBuffers[1]) return;
+
+    // Nascite del passo per emettitore: rate * dt, la frazione resta per il passo successivo
+    const uint32_t capacity = static_cast<uint32_t>(m_targetParticles);
+    GpuEmitter table[kMaxEmitters] = {};
+    uint32_t emitCount = 0u;
+    const int emitterCount = static_cast<int>(m_emitters.size());
+    for (int e = 0; e < emitterCount; ++e) {
+        const ParticleEmitter& emitter = m_emitters[e];
+        m_emitterCarry[e] += std::max(0.0f, emitter.rate) * dt;
+        const float whole = std::floor(m_emitterCarry[e]);
+        m_emitterCarry[e] -= whole;
+        const uint32_t births = static_cast<uint32_t>(std::min(whole, static_cast<float>(capacity - emitCount)));
+
+        GpuEmitter& g = table[e];
+        g.area[0] = emitter.x0; g.area[1] = emitter.y0; g.area[2] = emitter.x1; g.area[3] = emitter.y1;
+        g.motion[0] = emitter.angle;
+        g.motion[1] = emitter.spread;
+        g.motion[2] = std::max(0.0f, emitter.lifetimeMin);
+        g.motion[3] = std::max(g.motion[2], emitter.lifetimeMax);
+        g.range[0] = static_cast<uint32_t>(emitter.shape);
+        g.range[1] = emitCount;
+        g.range[2] = births;
+        emitCount += births;
+    }
+
+    const int nextBuffer = 1 - m_currentBuffer;
+    bindParticleStreams(m_currentBuffer, false);
+    bindParticleStreams(nextBuffer, true);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, m_particleLifeBuffers[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 23, m_particleLifeBuffers[1]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, m_compactGroupBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 25, m_particleCountBuffer);
+
+    // Compattazione: conteggi per gruppo, prefix sum + record pending, spostamento delle vive
+    glUseProgram(m_compactProgramID);
+    glUniform1f(glGetUniformLocation(m_compactProgramID, "uDt"), dt);
+    glUniform1ui(glGetUniformLocation(m_compactProgramID, "uEmitCount"), emitCount);
+    glUniform1ui(glGetUniformLocation(m_compactProgramID, "uCapacity"), capacity);
+    glUniform1i(glGetUniformLocation(m_compactProgramID, "uPass"), 0);
+    m_passGraph.access({ PassGraph::buffer(m_particleBuffers[m_currentBuffer], PassGraph::Access::StorageRead),
+                         PassGraph::buffer(m_particleLifeBuffers[0], PassGraph::Access::StorageRead),
+                         PassGraph::buffer(m_compactGroupBuffer, PassGraph::Access::StorageWrite) });
+    dispatchParticles(0, 256);
+    glUniform1i(glGetUniformLocation(m_compactProgramID, "uPass"), 1);
+    m_passGraph.access({ PassGraph::buffer(m_compactGroupBuffer, PassGraph::Access::StorageWrite),
+                         PassGraph::buffer(m_particleCountBuffer, PassGraph::Access::StorageWrite) });
+    glDispatchCompute(1, 1, 1);
+    glUniform1i(glGetUniformLocation(m_compactProgramID, "uPass"), 2);
+    m_passGraph.access({ PassGraph::buffer(m_particleBuffers[m_currentBuffer], PassGraph::Access::StorageRead),
+                         PassGraph::buffer(m_particleBuffers[nextBuffer], PassGraph::Access::StorageWrite),
+                         PassGraph::buffer(m_particleLifeBuffers[0], PassGraph::Access::StorageRead),
+                         PassGraph::buffer(m_particleLifeBuffers[1], PassGraph::Access::StorageWrite),
+                         PassGraph::buffer(m_compactGroupBuffer, PassGraph::Access::StorageRead),
+                         PassGraph::buffer(m_particleCountBuffer, PassGraph::Access::Indirect) });
+    dispatchParticles(0, 256);
+
+    // Nuove particelle in coda alle sopravvissute
+    if (emitCount > 0u) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_emitterBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, emitterCount * sizeof(GpuEmitter), table);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 26, m_emitterBuffer);
+
+        glUseProgram(m_emitProgramID);
+        glUniform1i(glGetUniformLocation(m_emitProgramID, "uEmitterCount"), emitterCount);
+        glUniform1ui(glGetUniformLocation(m_emitProgramID, "uEmitCount"), emitCount);
+        glUniform1ui(glGetUniformLocation(m_emitProgramID, "uEmitBase"), m_emittedTotal);
+        glUniform1ui(glGetUniformLocation(m_emitProgramID, "uRandomSeed"), m_randomSeed);
+        glUniform2f(glGetUniformLocation(m_emitProgramID, "uSimSize"), static_cast<float>(m_width), static_cast<float>(m_height));
+        glUniform1f(glGetUniformLocation(m_emitProgramID, "uSpeedMin"), m_speedMin);
+        glUniform1f(glGetUniformLocation(m_emitProgramID, "uSpeedMax"), m_speedMax);
+        glUniform1i(glGetUniformLocation(m_emitProgramID, "uSpeciesCount"), m_speciesCount);
+        m_passGraph.access({ PassGraph::buffer(m_particleBuffers[nextBuffer], PassGraph::Access::StorageWrite),
+                             PassGraph::buffer(m_particleLifeBuffers[1], PassGraph::Access::StorageWrite),
+                             PassGraph::buffer(m_particleCountBuffer, PassGraph::Access::StorageRead) });
+        glDispatchCompute((emitCount + 255u) / 256u, 1, 1);
+        m_emittedTotal += emitCount;
+    }
+
+    // pending -> corrente: da qui i pass per particella partono indiretti sul nuovo conteggio
+    m_passGraph.access({ PassGraph::buffer(m_particleCountBuffer, PassGraph::Access::Transfer) });
+    glBindBuffer(GL_COPY_READ_BUFFER, m_particleCountBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_particleCountBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sizeof(GpuParticleCount), 0, sizeof(GpuParticleCount));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    std::swap(m_particleLifeBuffers[0], m_particleLifeBuffers[1]);
+    m_currentBuffer = nextBuffer;
+    glUseProgram(0);
+}
+
+void SimulationGPU::dispatchParticles(int count, int groupSize)
+{
+    // La location di uParticleCount e' fissata dal prelude, uguale in tutti i programmi
+    if (m_emittersEnabled && m_emittersReady) {
+        m_passGraph.access({ PassGraph::buffer(m_particleCountBuffer, PassGraph::Access::Indirect),
+                             PassGraph::buffer(m_particleCountBuffer, PassGraph::Access::StorageRead) });
+        glUniform1i(Particles::kCountLocation, -1);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, Particles::kCountBinding, m_particleCountBuffer);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, m_particleCountBuffer);
+        glDispatchComputeIndirect(static_cast<GLintptr>(groupSize == 128 ? offsetof(GpuParticleCount, dispatch128)
+                                                                         : offsetof(GpuParticleCount, dispatch256)));
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    } else {
+        glUniform1i(Particles::kCountLocation, count);
+        glDispatchCompute((count + groupSize - 1) / groupSize, 1, 1);
+    }
+}
+
+void SimulationGPU::createParticleBuffers()
+{
+    // Con piu' stream ogni regione parte a un offset allineato per glBindBufferRange;
+    // il padding esce dallo stesso budget
+    GLint alignment = 256;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    const int streamCount = Particles::streamCount(m_particleLayout);
+    const size_t padding = static_cast<size_t>(streamCount - 1) * static_cast<size_t>(alignment);
+
+    // Un binding copre al massimo GL_MAX_SHADER_STORAGE_BLOCK_SIZE byte
+    GLint64 maxBlockSize = 0;
+    glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxBlockSize);
+    if (maxBlockSize > 0) {
+        m_particleBudgetBytes = std::min(m_particleBudgetBytes, static_cast<size_t>(maxBlockSize));
+    }
+
+    // Se il driver rifiuta l'allocazione (GL_OUT_OF_MEMORY, dove lo segnala subito) si riprova con 3/4
+    // del budget invece di fallire: su GPU piccole la capacita' scende, la simulazione parte comunque
+    const size_t minBudget = static_cast<size_t>(kMinParticleCapacity) * sizeof(GpuParticle);
+    for (;;) {
+        m_maxParticles = static_cast<int>(std::min<size_t>((m_particleBudgetBytes - padding) / Particles::stride(m_particleLayout),
+                                                           kMaxParticleCapacity));
+
+        size_t bufferSize = 0;
+        for (int s = 0; s < Particles::kMaxStreams; ++s) {
+            m_particleStreamOffsets[s] = bufferSize;
+            if (s >= streamCount) continue;
+            bufferSize += static_cast<size_t>(m_maxParticles) * Particles::stream(m_particleLayout, s).stride;
+            bufferSize = (bufferSize + alignment - 1) / alignment * alignment;
+        }
+        m_particleBufferSize = bufferSize;
+
+        // Il secondo buffer e' allocato alla prima attivazione di boids o collisioni
+        glGenBuffers(1, &m_particleBuffers[0]);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_particleBuffers[0]);
+        const GLenum error = allocateStorageBuffer(static_cast<GLsizeiptr>(bufferSize), "the particle buffer");
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        if (error != GL_OUT_OF_MEMORY || m_particleBudgetBytes <= minBudget) break;
+
+        glDeleteBuffers(1, &m_particleBuffers[0]);
+        m_particleBudgetBytes = std::max(minBudget, m_particleBudgetBytes / 4 * 3);
+        std::cout << "[Particles] Out of GPU memory for " << m_maxParticles << " particles, retrying with "
+                  << m_particleBudgetBytes / (1024 * 1024) << " MB" << std::endl;
+    }
+    m_particleBuffers[1] = 0;
+    m_currentBuffer = 0;
+}
+
+void SimulationGPU::ensureParticleBackBuffer(bool needed)
+{
+    if (needed == (m_particleBuffers[1] != 0)) return;
+
+    if (needed) {
+        if (m_backBufferFailed) return;
+        glGenBuffers(1, &m_particleBuffers[1]);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_particleBuffers[1]);
+        const GLenum error = allocateStorageBuffer(static_cast<GLsizeiptr>(m_particleBufferSize), "the second particle buffer");
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        if (error == GL_OUT_OF_MEMORY) {
+            // Niente double buffer: boids e collisioni leggono i vicini in place (letture miste vecchio/nuovo)
+            glDeleteBuffers(1, &m_particleBuffers[1]);
+            m_particleBuffers[1] = 0;
+            m_backBufferFailed = true;
+            std::cout << "[Particles] Out of GPU memory for the second buffer: neighbour passes run in place" << std::endl;
+            return;
+        }
+
+        // Anche le particelle inattive devono essere uguali nei due buffer
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindBuffer(GL_COPY_READ_BUFFER, m_particleBuffers[0]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_particleBuffers[1]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(m_particleBufferSize));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    } else {
+        // Lo stato corrente resta nel buffer 0
+        if (m_currentBuffer == 1) std::swap(m_particleBuffers[0], m_particleBuffers[1]);
+        m_currentBuffer = 0;
+        glDeleteBuffers(1, &m_particleBuffers[1]);
+        m_particleBuffers[1] = 0;
+    }
+}
+
+void SimulationGPU::downloadParticles(int start, int count, std::vector<GpuParticle>& out)
+{
+    std::vector<unsigned char> bytes;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_particleBuffers[m_currentBuffer]);
+    for (int s = 0; s < Particles::streamCount(m_particleLayout); ++s) {
+        const size_t stride = Particles::stream(m_particleLayout, s).stride;
+        bytes.resize(static_cast<size_t>(count) * stride);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, static_cast<GLintptr>(m_particleStreamOffsets[s] + static_cast<size_t>(start) * stride),
+                           static_cast<GLsizeiptr>(bytes.size()), bytes.data());
+        Particles::decode(bytes.data(), static_cast<size_t>(count), m_particleLayout, s, out);
+    }
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
+void SimulationGPU::bindParticleStreams(int buffer, bool output)
+{
+    for (int s = 0; s < Particles::streamCount(m_particleLayout); ++s) {
+        Particles::Stream stream = Particles::stream(m_particleLayout, s);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, output ? stream.outBinding : stream.inBinding, m_particleBuffers[buffer],
+                          static_cast<GLintptr>(m_particleStreamOffsets[s]),
+                          static_cast<GLsizeiptr>(static_cast<size_t>(m_maxParticles) * stream.stride));
+    }
+}
+
+void SimulationGPU::setParticleLayout(ParticleLayout layout)
+{
+    if (layout == m_particleLayout || layout >= ParticleLayout::Count) return;
+    if (m_initialized && !isParticleLayoutSupported(layout)) {
+        std::cout << "[Particles] Layout " << Particles::label(layout) << " needs "
+                  << Particles::storageBlocks(layout) + kMaxShaderOwnStorageBlocks << " SSBO blocks, driver allows "
+                  << m_maxComputeStorageBlocks << ": keeping " << Particles::label(m_particleLayout) << std::endl;
+        return;
+    }
+    m_particleLayout = layout;
+    if (!m_initialized) return;
+
+    glFinish();
+    m_passGraph.discardTimings();
+
+    // Buffer delle particelle e ParticleNext dipendono dal numero massimo di particelle
+    glDeleteBuffers(2, m_particleBuffers);
+    m_backBufferFailed = false;
+    createParticleBuffers();
+    if (m_gridHeadBuffer) { glDeleteBuffers(1, &m_gridHeadBuffer); m_gridHeadBuffer = 0; }
+    if (m_particleNextBuffer) { glDeleteBuffers(1, &m_particleNextBuffer); m_particleNextBuffer = 0; }
+    createGridBuffers();
+    releaseActivityBuffers();
+    releaseEmitterBuffers();
+
+    // Tutti gli shader che leggono ParticleRecord vanno ricompilati
+    GLuint* programs[] = {
+        &m_reactionProgramID,
+        &m_fftPackProgramID, &m_fftProgramID, &m_fftMultiplyProgramID, &m_fftUnpackProgramID,
+        &m_zoneCountProgramID, &m_zoneSatProgramID, &m_activityProgramID,
+        &m_gridResetProgramID, &m_gridBuildProgramID, &m_detUpdateProgramID, &m_seedProgramID,
+        &m_compactProgramID, &m_emitProgramID, &m_rescaleProgramID, &m_speciesProgramID
+    };
+    for (GLuint* program : programs) {
+        if (*program) { glDeleteProgram(*program); *program = 0; }
+    }
+    releaseFormatPrograms(true);   // solo gli update: blur, mip e resample non leggono le particelle
+    createComputeShaders();
+
+    m_currentBuffer = 0;
+    initializeParticles();
+    m_activeParticles = 0;
+    m_targetParticles = std::min(m_targetParticles, m_maxParticles);
+
+    std::cout << "[Particles] Layout " << Particles::label(m_particleLayout) << ", max "
+              << m_maxParticles << " particles" << std::endl;
+}
+
+bool SimulationGPU::isParticleLayoutSupported(ParticleLayout layout) const
+{
+    // Senza contesto (prima di initialize) il limite non e' noto: la verifica la rifa' initialize
+    if (m_maxComputeStorageBlocks <= 0) return true;
+    return Particles::storageBlocks(layout) + kMaxShaderOwnStorageBlocks <= m_maxComputeStorageBlocks;
+}
+
 void SimulationGPU::createGridBuffers()
 {
     // Calcola dimensione griglia
@@ -603,99 +1944,458 @@ void SimulationGPU::rebuildGridIfNeeded()
     createGridBuffers();
 }
 
-void SimulationGPU::printPerformanceStats()
+void SimulationGPU::createZoneBuffers()
 {
-    GLint available = 0;
-    // Check if Last query is available
-    glGetQueryObjectiv(m_timeQueries[3], GL_QUERY_RESULT_AVAILABLE, &available);
-    if (!available) return;
+    if (m_zoneCountBuffer) { glDeleteBuffers(1, &m_zoneCountBuffer); m_zoneCountBuffer = 0; }
+    if (m_zoneSatBuffer) { glDeleteBuffers(1, &m_zoneSatBuffer); m_zoneSatBuffer = 0; }
+
+    m_zoneBufferCellSize = m_zoneCellSize;
+    m_zoneGridWidth = std::max(1, static_cast<int>(std::ceil(m_width / m_zoneCellSize)));
+    m_zoneGridHeight = std::max(1, static_cast<int>(std::ceil(m_height / m_zoneCellSize)));
+    const size_t cells = static_cast<size_t>(m_zoneGridWidth) * m_zoneGridHeight;
+    const size_t satCells = static_cast<size_t>(m_zoneGridWidth + 1) * (m_zoneGridHeight + 1);
+
+    glGenBuffers(1, &m_zoneCountBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_zoneCountBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, cells * 4 * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+
+    // Riga e colonna 0 della SAT non vengono mai scritte dagli shader: restano a zero da qui
+    std::vector<GLuint> zeros(satCells * 4, 0u);
+    glGenBuffers(1, &m_zoneSatBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_zoneSatBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, satCells * 4 * sizeof(GLuint), zeros.data(), GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
 
-    GLuint64 times[4];
-    glGetQueryObjectui64v(m_timeQueries[0], GL_QUERY_RESULT, &times[0]);
-    glGetQueryObjectui64v(m_timeQueries[1], GL_QUERY_RESULT, &times[1]);
-    glGetQueryObjectui64v(m_timeQueries[2], GL_QUERY_RESULT, &times[2]);
-    glGetQueryObjectui64v(m_timeQueries[3], GL_QUERY_RESULT, &times[3]);
-    
-    double gridMs = (times[1] - times[0]) / 1000000.0;
-    double updateMs = (times[2] - times[1]) / 1000000.0;
-    double blurMs = (times[3] - times[2]) / 1000000.0;
+void SimulationGPU::buildZoneDensity(int activeCount)
+{
+    if (!m_zoneSatBuffer || m_zoneBufferCellSize != m_zoneCellSize) {
+        createZoneBuffers();
+    }
+
+    const GLuint zero = 0u;
+    m_passGraph.access({ PassGraph::buffer(m_zoneCountBuffer, PassGraph::Access::Transfer) });
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_zoneCountBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    bindParticleStreams(m_currentBuffer, false);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kZoneCountBinding, m_zoneCountBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kZoneSatBinding, m_zoneSatBuffer);
+
+    glUseProgram(m_zoneCountProgramID);
+    glUniform1f(glGetUniformLocation(m_zoneCountProgramID, "uZoneCellSize"), m_zoneCellSize);
+    glUniform2i(glGetUniformLocation(m_zoneCountProgramID, "uZoneGridSize"), m_zoneGridWidth, m_zoneGridHeight);
+    m_passGraph.access({ PassGraph::buffer(m_particleBuffers[m_currentBuffer], PassGraph::Access::StorageRead),
+                         PassGraph::buffer(m_zoneCountBuffer, PassGraph::Access::StorageWrite) });
+    dispatchParticles(activeCount, 256);
+
+    // Prefissi per righe, poi per colonne (una invocazione per linea: la griglia e' piccola)
+    glUseProgram(m_zoneSatProgramID);
+    glUniform2i(glGetUniformLocation(m_zoneSatProgramID, "uZoneGridSize"), m_zoneGridWidth, m_zoneGridHeight);
+    glUniform1i(glGetUniformLocation(m_zoneSatProgramID, "uPass"), 0);
+    m_passGraph.access({ PassGraph::buffer(m_zoneCountBuffer, PassGraph::Access::StorageRead),
+                         PassGraph::buffer(m_zoneSatBuffer, PassGraph::Access::StorageWrite) });
+    glDispatchCompute((m_zoneGridHeight + 63) / 64, 1, 1);
+    glUniform1i(glGetUniformLocation(m_zoneSatProgramID, "uPass"), 1);
+    m_passGraph.access({ PassGraph::buffer(m_zoneSatBuffer, PassGraph::Access::StorageWrite) });
+    glDispatchCompute((m_zoneGridWidth + 63) / 64, 1, 1);
+}
+
+void SimulationGPU::releaseActivityBuffers()
+{
+    for (int i = 0; i < 2; ++i) {
+        if (m_activityFences[i]) { glDeleteSync(m_activityFences[i]); m_activityFences[i] = nullptr; }
+    }
+    if (m_activityTileBuffer) { glDeleteBuffers(1, &m_activityTileBuffer); m_activityTileBuffer = 0; }
+    if (m_activityPartialBuffer) { glDeleteBuffers(1, &m_activityPartialBuffer); m_activityPartialBuffer = 0; }
+    if (m_activityMetricBuffers[0]) { glDeleteBuffers(2, m_activityMetricBuffers); m_activityMetricBuffers[0] = m_activityMetricBuffers[1] = 0; }
+    m_activityTilesX = m_activityTilesY = 0;
+    m_activityPrevEnergy = 0.0f;
+}
+
+void SimulationGPU::readActivityMetrics()
+{
+    // Prima il set piu' vecchio: e' quello che verra' riscritto al prossimo campionamento
+    for (int i = 0; i < 2; ++i) {
+        const int set = (m_activitySet + i) % 2;
+        GLsync fence = m_activityFences[set];
+        if (!fence) continue;
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+        glDeleteSync(fence);
+        m_activityFences[set] = nullptr;
+
+        float metrics[4] = {};
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_activityMetricBuffers[set]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(metrics), metrics);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        // Energia media per particella: il ramp-up non si confonde con un cambio di dinamica
+        float energy = (metrics[3] > 0.0f) ? metrics[2] / metrics[3] : 0.0f;
+        m_activity.trailChange = metrics[0] / std::max(metrics[1], 1e-3f);
+        m_activity.energyChange = (m_activityPrevEnergy > 0.0f)
+            ? std::abs(energy - m_activityPrevEnergy) / m_activityPrevEnergy
+            : (energy > 0.0f ? 1.0f : 0.0f);
+        m_activityPrevEnergy = energy;
+        m_activity.sample++;
+    }
+}
+
+void SimulationGPU::sampleActivity()
+{
+    readActivityMetrics();
+    const int set = m_activitySet;
+    if (m_activityFences[set]) return;   // GPU indietro di due campionamenti: salta questo
+
+    const int tilesX = (m_trailWidth + 15) / 16;
+    const int tilesY = (m_trailHeight + 15) / 16;
+    if (!m_activityTileBuffer || tilesX != m_activityTilesX || tilesY != m_activityTilesY) {
+        releaseActivityBuffers();
+        m_activityTilesX = tilesX;
+        m_activityTilesY = tilesY;
+
+        // Somme precedenti a zero: il primo campionamento risulta "tutto cambiato"
+        std::vector<float> zeros(static_cast<size_t>(tilesX) * tilesY * 2, 0.0f);
+        glGenBuffers(1, &m_activityTileBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_activityTileBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, zeros.size() * sizeof(float), zeros.data(), GL_DYNAMIC_COPY);
+
+        glGenBuffers(1, &m_activityPartialBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_activityPartialBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<size_t>(m_maxParticles / 256 + 1) * sizeof(float), nullptr, GL_DYNAMIC_COPY);
+
+        glGenBuffers(2, m_activityMetricBuffers);
+        for (int i = 0; i < 2; ++i) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_activityMetricBuffers[i]);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(float), nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    glUseProgram(m_activityProgramID);
+    glUniform2i(glGetUniformLocation(m_activityProgramID, "uTileCount"), tilesX, tilesY);
+    bindParticleStreams(m_currentBuffer, false);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, m_activityTileBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, m_activityPartialBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, m_activityMetricBuffers[set]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_textureIDIn);
+
+    glUniform1i(glGetUniformLocation(m_activityProgramID, "uPass"), 0);
+    m_passGraph.access({ PassGraph::texture(m_textureIDIn, PassGraph::Access::Sampled, 0),
+                         PassGraph::buffer(m_activityTileBuffer, PassGraph::Access::StorageWrite) });
+    glDispatchCompute(tilesX, tilesY, 1);
+    // Imposta anche il conteggio (uniform o buffer in GPU) letto dal pass 2
+    glUniform1i(glGetUniformLocation(m_activityProgramID, "uPass"), 1);
+    m_passGraph.access({ PassGraph::buffer(m_particleBuffers[m_currentBuffer], PassGraph::Access::StorageRead),
+                         PassGraph::buffer(m_activityPartialBuffer, PassGraph::Access::StorageWrite) });
+    dispatchParticles(m_activeParticles, 256);
+    glUniform1i(glGetUniformLocation(m_activityProgramID, "uPass"), 2);
+    m_passGraph.access({ PassGraph::buffer(m_activityTileBuffer, PassGraph::Access::StorageRead),
+                         PassGraph::buffer(m_activityPartialBuffer, PassGraph::Access::StorageRead),
+                         PassGraph::buffer(m_activityMetricBuffers[set], PassGraph::Access::StorageWrite) });
+    glDispatchCompute(1, 1, 1);
+    // Il readback del metric buffer (glGetBufferSubData, passi dopo) e' coperto dal flush di fine passo
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_activityFences[set] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_activitySet = 1 - set;
+}
+
+void SimulationGPU::printPerformanceStats()
+{
+    // Tempi per pass del set appena letto dal grafo (beginFrame); la griglia comprende le zone, gli emettitori
+    // hanno un tempo a parte (altrimenti le medie della griglia dipenderebbero dalla popolazione viva)
+    const int set = m_passGraph.collectedSet();
+    const bool samplerSet = m_timeQuerySampler[set];
+    auto passMs = [this](SimPass pass) { return m_passGraph.passMs(static_cast<int>(pass)); };
+    const float gridMs = passMs(SimPass::Grid) + passMs(SimPass::Zones);
+    const float updateMs = passMs(SimPass::Update);
+    const float blurMs = passMs(SimPass::Blur);
+    m_lastGridMs = gridMs;
+    m_lastUpdateMs = updateMs;
+    m_lastBlurMs = blurMs;
+    m_lastReactionMs = passMs(SimPass::Reaction);
+    m_lastEmitterMs = passMs(SimPass::Emitters);
+
+    // Media mobile per formato, solo a regime: durante il ramp-up le particelle attive sono meno
+    if (m_timeQuerySteady[set]) {
+        FormatTiming& ft = m_formatTimings[static_cast<int>(m_timeQueryFormat[set])];
+        float alpha = (ft.samples < 20) ? 1.0f / static_cast<float>(ft.samples + 1) : 0.05f;
+        ft.updateMs += (m_lastUpdateMs - ft.updateMs) * alpha;
+        ft.blurMs   += (m_lastBlurMs - ft.blurMs) * alpha;
+        ft.samples++;
+
+        FormatTiming& st = m_sensingTimings[samplerSet ? 1 : 0];
+        alpha = (st.samples < 20) ? 1.0f / static_cast<float>(st.samples + 1) : 0.05f;
+        st.updateMs += (m_lastUpdateMs - st.updateMs) * alpha;
+        st.blurMs   += (m_lastBlurMs - st.blurMs) * alpha;
+        st.samples++;
+    }
     
     static int logCounter = 0;
     if (logCounter++ % 60 == 0) {
          std::cout << "[GPU] Grid: " << gridMs << "ms | Update: " << updateMs 
-                   << "ms | Blur: " << blurMs << "ms" << std::endl;
+                   << "ms | Blur: " << blurMs << "ms | Reaction: " << m_lastReactionMs << "ms | Emitters: " << m_lastEmitterMs << "ms | CPU submit: " << m_submitMs
+                   << "ms | Barriers: " << m_passGraph.getLastBarrierCount() << std::endl;
     }
 }
-void SimulationGPU::resize(int width, int height, TextureFormat format)
+void SimulationGPU::updateTrailSize()
 {
-    if (m_width == width && m_height == height && m_textureFormat == format) return;
+    m_trailWidth  = std::max(1, (m_width  + m_trailDivisor - 1) / m_trailDivisor);
+    m_trailHeight = std::max(1, (m_height + m_trailDivisor - 1) / m_trailDivisor);
+}
+
+void SimulationGPU::resize(int width, int height, TextureFormat format, int trailDivisor)
+{
+    trailDivisor = (trailDivisor >= 4) ? 4 : (trailDivisor >= 2 ? 2 : 1);
+    if (m_width == width && m_height == height && m_textureFormat == format && m_trailDivisor == trailDivisor) return;
+
+    // Lo stato sopravvive al resize: particelle (e conteggio degli emettitori) restano nei loro buffer con
+    // le posizioni riscalate, trail e campo di reazione vengono ricampionati nelle nuove texture.
+    // Nessun glFinish: i pass sotto sono ordinati dal driver dopo il lavoro gia' accodato.
+    const float scaleX = static_cast<float>(width) / static_cast<float>(m_width);
+    const float scaleY = static_cast<float>(height) / static_cast<float>(m_height);
+    const bool sizeChanged = (m_width != width || m_height != height);
 
     m_width = width;
     m_height = height;
     m_textureFormat = format;
+    m_trailDivisor = trailDivisor;
+    updateTrailSize();
 
-    // Wait until GPU is idle
-    glFinish();
+    // I timestamp in volo appartengono alla configurazione precedente
+    m_passGraph.discardTimings();
 
-    // Recreate Textures
-    glDeleteTextures(1, &m_textureIDIn);
-    glDeleteTextures(1, &m_textureIDOut);
+    // Programmi del nuovo formato: compilati solo la prima volta che il formato viene usato
+    selectFormatPrograms();
+
+    GLuint oldTextures[4] = { m_textureIDIn, m_textureIDOut, m_fieldIDIn, m_fieldIDOut };
     createTextures();
+    resampleTexture(oldTextures[0], m_textureIDIn, m_trailWidth, m_trailHeight, m_textureFormat);
+    resampleTexture(oldTextures[2], m_fieldIDIn, m_trailWidth, m_trailHeight, TextureFormat::RGBA16F);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDeleteTextures(4, oldTextures);
+    if (m_trailPyramidEnabled && m_trailLevels > 1) {
+        buildTrailPyramid();
+        m_passGraph.flush();
+    }
+    m_deterministicReady = false;  // la trail intera ha le dimensioni della trail map
+    if (!sizeChanged) return;
 
     // Recreate Grid (depends on width/height)
     if (m_gridHeadBuffer) { glDeleteBuffers(1, &m_gridHeadBuffer); m_gridHeadBuffer = 0; }
     if (m_particleNextBuffer) { glDeleteBuffers(1, &m_particleNextBuffer); m_particleNextBuffer = 0; }
     createGridBuffers();
+    m_zoneBufferCellSize = 0.0f;  // griglia delle zone riallocata al prossimo step
 
-    // Recompile Shaders (Defines changed)
-    if (m_updateProgramID) glDeleteProgram(m_updateProgramID);
-    if (m_blurProgramID) glDeleteProgram(m_blurProgramID);
-    // grid shaders don't change
-    createComputeShaders();
+    rescaleParticles(scaleX, scaleY);
+}
+
+void SimulationGPU::setRandomSeed(uint32_t seed)
+{
+    m_randomSeed = seed;
+    m_rngStep = 0;
+    m_seedBatch = 0;
+    m_deterministicReady = false;
+    if (!m_initialized) return;
+
+    glFinish();
+    m_passGraph.discardTimings();
+
+    // Trail (tutti i livelli) e campo di reazione da zero, particelle di nuovo al centro
+    const float zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (GLuint tex : {m_textureIDIn, m_textureIDOut}) {
+        for (int level = 0; level < m_trailLevels; ++level) {
+            glClearTexImage(tex, level, GL_RGBA, GL_FLOAT, zero);
+        }
+    }
+    resetReactionField();
 
-    // Re-distribute particles to new bounds
-    // Re-distribute particles: Start from scratch with ramp up
+    ensureParticleBackBuffer(false);
     initializeParticles();
-    m_activeParticles = 0; // Reset active count to trigger ramp-up again
-    m_targetParticles = m_maxParticles; // Should preserve current target actually? Let's check main.
-                                        // Main sets targetParticleCount every frame. So it will ramp up to that.
+    releaseEmitterBuffers();
+    m_activeParticles = 0;
 }
 
-void SimulationGPU::resetParticlePositions(int startIdx, int count)
+// --------------------------------------------------
+// Modalita' deterministica
+
+void SimulationGPU::setDeterministicEnabled(bool enabled)
 {
-    if (count <= 0) return;
-    
-    std::vector<GpuParticle> particles(count);
-    float cx = m_width * 0.5f;
-    float cy = m_height * 0.5f;
-    
-    for (int i = 0; i < count; ++i)
-    {
-        // Random point in a small circle at center
-        float r = 10.0f * sqrt(static_cast<float>(rand()) / RAND_MAX);
-        float theta = static_cast<float>(rand()) / RAND_MAX * 6.2831853f;
-        
-        particles[i].position[0] = cx + r * cos(theta);
-        particles[i].position[1] = cy + r * sin(theta);
-        
-        // Random direction out
-        particles[i].angle = theta; // Explode outwards
-        // Or random angle:
-        // particles[i].angle = static_cast<float>(rand()) / RAND_MAX * 6.2831853f;
+    if (enabled == m_deterministicEnabled) return;
+    m_deterministicEnabled = enabled;
+    m_deterministicReady = false;
+    if (!enabled) releaseDeterministicBuffers();
+}
+
+void SimulationGPU::setDeterministicReferenceEnabled(bool enabled)
+{
+    if (enabled == m_deterministicReference) return;
+    // La CPU deve partire dallo stesso stato della GPU: si riparte dal passo 0
+    m_deterministicReference = enabled;
+    m_deterministicReady = false;
+}
+
+Deterministic::Params SimulationGPU::deterministicParams() const
+{
+    Deterministic::Params params;
+    params.width = m_width;
+    params.height = m_height;
+    params.trailDivisor = m_trailDivisor;
+    params.trailWidth = m_trailWidth;
+    params.trailHeight = m_trailHeight;
+    // Passo fisso di 1/60 s: la velocita' diventa px per passo
+    params.speed = Deterministic::toFixed(m_speed / 60.0f, 8, 0, Deterministic::kMaxSpeed);
+    for (int s = 0; s < kSpeciesCount; ++s) {
+        params.sensorDistance[s] = Deterministic::toFixed(m_sensorDistance * m_speciesSettings[s].sensorScale, 4, 0,
+                                                          Deterministic::kMaxSensorDistance);
+    }
+    params.sensorAngle = Deterministic::angleToSteps(m_sensorAngle);
+    params.turnAngle = Deterministic::angleToSteps(m_turnAngle);
+    params.deposit = static_cast<uint32_t>(Deterministic::toFixed(0.05f * m_physarumIntensity, 12, 0,
+                                                                  static_cast<int32_t>(Deterministic::kTrailMax)));
+    params.fade = static_cast<uint32_t>(Deterministic::toFixed(m_trailFade, 16, 0, 65536));
+    params.seed = m_randomSeed;
+    return params;
+}
 
-        float rnd = static_cast<float>(rand()) / RAND_MAX;
-        particles[i].speed = m_speedMin + rnd * (m_speedMax - m_speedMin);
-        particles[i].species = static_cast<float>(rand() % 3);
-        particles[i]._pad[0] = 0; particles[i]._pad[1] = 0; particles[i]._pad[2] = 0;
+void SimulationGPU::releaseDeterministicBuffers()
+{
+    GLuint* buffers[] = { &m_detAgentBuffer, &m_detTrailBuffers[0], &m_detTrailBuffers[1],
+                          &m_detDepositBuffer, &m_detDirectionBuffer };
+    for (GLuint* buffer : buffers) {
+        if (*buffer) { glDeleteBuffers(1, buffer); *buffer = 0; }
     }
+    m_deterministicReady = false;
+}
 
-    GLintptr offset = static_cast<GLintptr>(startIdx) * sizeof(GpuParticle);
-    GLsizeiptr sizeBytes = static_cast<GLsizeiptr>(count) * sizeof(GpuParticle);
-    
-    // Update both buffers just in case
-    for (int i = 0; i < 2; ++i) {
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_particleBuffers[i]);
-        glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, sizeBytes, particles.data());
+void SimulationGPU::resetDeterministic()
+{
+    if (std::max(m_width, m_height) > Deterministic::kMaxSize) {
+        throw std::runtime_error("Deterministic mode: simulation size exceeds 32767 px");
+    }
+    releaseDeterministicBuffers();
+
+    // Stato iniziale generato sulla CPU (funzione di seme e dimensioni) e caricato identico sulla GPU
+    const Deterministic::Params params = deterministicParams();
+    const int agents = std::max(1, std::min(m_targetParticles, m_maxParticles));
+    std::vector<Deterministic::Agent> seeded;
+    Deterministic::seedAgents(params, agents, seeded);
+    const size_t cellBytes = static_cast<size_t>(m_trailWidth) * m_trailHeight * sizeof(GLuint);
+    const std::vector<int32_t>& directions = Deterministic::directionTable();
+    const GLuint zero = 0u;
+
+    glGenBuffers(1, &m_detAgentBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_detAgentBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, seeded.size() * sizeof(Deterministic::Agent), seeded.data(), GL_DYNAMIC_COPY);
+
+    for (GLuint* buffer : { &m_detTrailBuffers[0], &m_detTrailBuffers[1], &m_detDepositBuffer }) {
+        glGenBuffers(1, buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, cellBytes, nullptr, GL_DYNAMIC_COPY);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    }
+
+    glGenBuffers(1, &m_detDirectionBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_detDirectionBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, directions.size() * sizeof(int32_t), directions.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    if (m_deterministicReference) m_detReference.reset(params, agents);
+
+    m_deterministicAgents = agents;
+    m_deterministicTrailWidth = m_trailWidth;
+    m_deterministicTrailHeight = m_trailHeight;
+    m_deterministicStep = 0;
+    m_deterministicHash = 0;
+    m_deterministicDiverged = false;
+    m_deterministicReady = true;
+
+    std::cout << "[Deterministic] " << agents << " agents, trail " << m_trailWidth << "x" << m_trailHeight
+              << ", seed " << m_randomSeed << std::endl;
+}
+
+void SimulationGPU::stepDeterministic()
+{
+    if (!m_deterministicReady || m_deterministicAgents != std::max(1, std::min(m_targetParticles, m_maxParticles))
+        || m_deterministicTrailWidth != m_trailWidth || m_deterministicTrailHeight != m_trailHeight) {
+        resetDeterministic();
     }
+
+    const Deterministic::Params params = deterministicParams();
+
+    // --- Agenti: sensing sulla trail del passo precedente, movimento, depositi atomici ---
+    glUseProgram(m_detUpdateProgramID);
+    glUniform1i(glGetUniformLocation(m_detUpdateProgramID, "uAgentCount"), m_deterministicAgents);
+    glUniform2i(glGetUniformLocation(m_detUpdateProgramID, "uSimSize"), params.width, params.height);
+    glUniform1i(glGetUniformLocation(m_detUpdateProgramID, "uTrailDivisor"), params.trailDivisor);
+    glUniform1i(glGetUniformLocation(m_detUpdateProgramID, "uTrailWidth"), params.trailWidth);
+    glUniform1i(glGetUniformLocation(m_detUpdateProgramID, "uSpeed"), params.speed);
+    glUniform1iv(glGetUniformLocation(m_detUpdateProgramID, "uSensorDistance"), kSpeciesCount, params.sensorDistance);
+    glUniform1ui(glGetUniformLocation(m_detUpdateProgramID, "uSensorAngle"), params.sensorAngle);
+    glUniform1ui(glGetUniformLocation(m_detUpdateProgramID, "uTurnAngle"), params.turnAngle);
+    glUniform1ui(glGetUniformLocation(m_detUpdateProgramID, "uDeposit"), params.deposit);
+    glUniform1ui(glGetUniformLocation(m_detUpdateProgramID, "uSeed"), params.seed);
+    glUniform1ui(glGetUniformLocation(m_detUpdateProgramID, "uStep"), m_deterministicStep);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, m_detAgentBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, m_detTrailBuffers[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, m_detDepositBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 19, m_detDirectionBuffer);
+    glDispatchCompute((m_deterministicAgents + 255) / 256, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // --- Trail: depositi, media 3x3 e decadimento nel buffer successivo + texture visualizzata ---
+    glUseProgram(m_detTrailProgramID);
+    glUniform2i(glGetUniformLocation(m_detTrailProgramID, "uTrailSize"), params.trailWidth, params.trailHeight);
+    glUniform1ui(glGetUniformLocation(m_detTrailProgramID, "uFade"), params.fade);
+    glUniform3fv(glGetUniformLocation(m_detTrailProgramID, "uColor"), 1, m_color1);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, m_detTrailBuffers[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, m_detDepositBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 20, m_detTrailBuffers[1]);
+    GLenum glFormat = getTextureFormatInfo(m_textureFormat).internalFormat;
+    glBindImageTexture(1, m_textureIDIn, 0, GL_FALSE, 0, GL_WRITE_ONLY, glFormat);
+    glDispatchCompute((m_trailWidth + 15) / 16, (m_trailHeight + 15) / 16, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+                    GL_TEXTURE_FETCH_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    const GLuint zero = 0u;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_detDepositBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    std::swap(m_detTrailBuffers[0], m_detTrailBuffers[1]);
+
+    if (m_deterministicReference) m_detReference.step(params);
+    ++m_deterministicStep;
+    if (m_deterministicStep % static_cast<uint32_t>(m_deterministicHashInterval) == 0) {
+        checkDeterministicHash();
+    }
+}
+
+void SimulationGPU::checkDeterministicHash()
+{
+    // Readback sincrono (solo ogni hashInterval passi), hash sulla CPU in ordine di indice
+    std::vector<Deterministic::Agent> agents(m_deterministicAgents);
+    std::vector<GLuint> trail(static_cast<size_t>(m_trailWidth) * m_trailHeight);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_detAgentBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, agents.size() * sizeof(Deterministic::Agent), agents.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_detTrailBuffers[0]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, trail.size() * sizeof(GLuint), trail.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    m_deterministicHash = Deterministic::stateHash(agents.data(), agents.size(), trail.data(), trail.size());
+
+    char line[128];
+    std::snprintf(line, sizeof(line), "[Deterministic] step %u hash 0x%016llx", m_deterministicStep,
+                  static_cast<unsigned long long>(m_deterministicHash));
+    std::cout << line;
+    if (m_deterministicReference) {
+        uint64_t reference = m_detReference.stateHash();
+        bool match = (reference == m_deterministicHash && m_detReference.getStep() == m_deterministicStep);
+        if (!match) m_deterministicDiverged = true;
+        std::snprintf(line, sizeof(line), " cpu 0x%016llx %s", static_cast<unsigned long long>(reference),
+                      match ? "MATCH" : "DIVERGED");
+        std::cout << line;
+    }
+    std::cout << std::endl;
 }
@@ -1,5 +1,9 @@
 #include "Utils.h"
+#include <algorithm>
 #include <cctype>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
 
 namespace Utils
 {
@@ -233,6 +237,132 @@ namespace Utils
         return sanitized;
     }
 
+    GpuMemoryInfo queryGpuMemory()
+    {
+        // Enum delle estensioni (non presenti nel loader glad generato per il core profile)
+        constexpr GLenum kDedicatedVidmemNVX = 0x9047;
+        constexpr GLenum kAvailableVidmemNVX = 0x9049;
+        constexpr GLenum kTextureFreeMemoryATI = 0x87FC;
+
+        bool hasNVX = false;
+        bool hasATI = false;
+        GLint extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (GLint i = 0; i < extensionCount; ++i)
+        {
+            const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+            if (!name) continue;
+            if (std::strcmp(name, "GL_NVX_gpu_memory_info") == 0) hasNVX = true;
+            else if (std::strcmp(name, "GL_ATI_meminfo") == 0) hasATI = true;
+        }
+
+        // Entrambe le estensioni riportano KB
+        GpuMemoryInfo info;
+        if (hasNVX)
+        {
+            GLint dedicated = 0, available = 0;
+            glGetIntegerv(kDedicatedVidmemNVX, &dedicated);
+            glGetIntegerv(kAvailableVidmemNVX, &available);
+            info.totalBytes = static_cast<uint64_t>(dedicated) * 1024ull;
+            info.availableBytes = static_cast<uint64_t>(available) * 1024ull;
+            info.source = "GL_NVX_gpu_memory_info";
+        }
+        else if (hasATI)
+        {
+            // [0] = memoria libera totale del pool texture, [1] = blocco libero piu' grande, [2..3] = memoria ausiliaria
+            GLint free[4] = {0, 0, 0, 0};
+            glGetIntegerv(kTextureFreeMemoryATI, free);
+            info.availableBytes = static_cast<uint64_t>(free[0]) * 1024ull;
+            info.source = "GL_ATI_meminfo";
+        }
+        return info;
+    }
+
+    void loadLuminanceImage(const std::string& path, std::vector<uint8_t>& luminance, int& width, int& height)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Cannot open image: " + path);
+        }
+
+        // Intestazione: magic, larghezza, altezza, maxval separati da spazi, con commenti '#' fino a fine riga
+        auto readHeaderValue = [&]() {
+            int c = file.get();
+            while (c != EOF && (std::isspace(c) || c == '#'))
+            {
+                if (c == '#') while (c != EOF && c != '\n') c = file.get();
+                c = file.get();
+            }
+            long value = -1;
+            while (c != EOF && std::isdigit(c))
+            {
+                value = (value < 0 ? 0 : value * 10) + (c - '0');
+                if (value > (1L << 24)) break;
+                c = file.get();
+            }
+            return value;
+        };
+
+        char magic[2] = { 0, 0 };
+        file.read(magic, 2);
+        const bool gray = (magic[1] == '2' || magic[1] == '5');
+        const bool binary = (magic[1] == '5' || magic[1] == '6');
+        if (!file || magic[0] != 'P' || (magic[1] < '2' || magic[1] > '6' || magic[1] == '4'))
+        {
+            throw std::runtime_error("Not a PGM/PPM image: " + path);
+        }
+        const long w = readHeaderValue();
+        const long h = readHeaderValue();
+        const long maxValue = readHeaderValue();   // consuma anche il singolo spazio prima dei dati binari
+        if (w <= 0 || h <= 0 || w > 16384 || h > 16384 || maxValue <= 0 || maxValue > 65535)
+        {
+            throw std::runtime_error("Invalid PGM/PPM header: " + path);
+        }
+
+        const int channels = gray ? 1 : 3;
+        const size_t pixels = static_cast<size_t>(w) * static_cast<size_t>(h);
+        const size_t sampleBytes = (maxValue > 255) ? 2 : 1;
+        std::vector<unsigned int> samples(pixels * channels);
+        if (binary)
+        {
+            std::vector<unsigned char> raw(samples.size() * sampleBytes);
+            file.read(reinterpret_cast<char*>(raw.data()), static_cast<std::streamsize>(raw.size()));
+            if (!file)
+            {
+                throw std::runtime_error("Truncated image: " + path);
+            }
+            for (size_t i = 0; i < samples.size(); ++i)
+            {
+                // Campioni a 16 bit big-endian
+                samples[i] = (sampleBytes == 2) ? (raw[2 * i] << 8u) | raw[2 * i + 1] : raw[i];
+            }
+        }
+        else
+        {
+            for (unsigned int& sample : samples)
+            {
+                const long value = readHeaderValue();
+                if (value < 0)
+                {
+                    throw std::runtime_error("Truncated image: " + path);
+                }
+                sample = static_cast<unsigned int>(value);
+            }
+        }
+
+        luminance.resize(pixels);
+        for (size_t i = 0; i < pixels; ++i)
+        {
+            float value = 0.0f;
+            if (gray) value = static_cast<float>(samples[i]);
+            else value = 0.2126f * samples[3 * i] + 0.7152f * samples[3 * i + 1] + 0.0722f * samples[3 * i + 2];
+            luminance[i] = static_cast<uint8_t>(std::clamp(value * 255.0f / static_cast<float>(maxValue) + 0.5f, 0.0f, 255.0f));
+        }
+        width = static_cast<int>(w);
+        height = static_cast<int>(h);
+    }
+
     // {
     //     ...
     // }
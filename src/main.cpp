@@ -10,6 +10,7 @@
 #include <filesystem>
 #include <vector>
 #include <cstdio>
+#include <cstdlib>
 
 // ImGui
 #include <imgui.h>
@@ -24,6 +25,7 @@
 #include "WindowManager.h"
 #include "RenderPipeline.h"
 #include "SimulationGPU.h"
+#include "ProgramCache.h"
 #include "GpuDiagnostics.h"
 #include "Utils.h"
 #include "InputHandler.h"
@@ -32,6 +34,29 @@ int main(int argc, char **argv)
 {
     try
     {
+        // Riga di comando: --max-particles N fissa la capacita', --memory-budget MB il budget da cui ricavarla,
+        // --seed-image FILE (PGM/PPM) semina il ramp-up dalla luminanza dell'immagine
+        long long maxParticlesArg = 0;
+        long long memoryBudgetArg = 0;
+        std::string seedImageArg;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            auto positiveValue = [&]() {
+                if (i + 1 >= argc) throw std::runtime_error("Missing value for " + arg);
+                long long value = std::atoll(argv[++i]);
+                if (value <= 0) throw std::runtime_error("Invalid value for " + arg + ": " + argv[i]);
+                return value;
+            };
+            if (arg == "--max-particles") maxParticlesArg = positiveValue();
+            else if (arg == "--memory-budget") memoryBudgetArg = positiveValue();
+            else if (arg == "--seed-image") {
+                if (i + 1 >= argc) throw std::runtime_error("Missing value for " + arg);
+                seedImageArg = argv[++i];
+            }
+            else std::cout << "[Args] Opzione sconosciuta ignorata: " << arg << std::endl;
+        }
+
         // 0. GPU DIAGNOSTICS (prima di creare la finestra)
         const auto gpuAdapters = Utils::enumerateGpuAdapters();
         const auto preferredGpu = Utils::pickBestGpu(gpuAdapters);
@@ -154,10 +179,33 @@ int main(int argc, char **argv)
             float sensorDistance = 20.0f;
             float sensorAngle = 0.785f;
             float turnAngle = 0.785f;
+            bool  samplerSensing = true;         // sensori sul frame precedente via sampler (false = imageLoad legacy)
+            bool  trailPyramid = false;          // sensing multi-scala sulla piramide mip della trail
+            float pyramidBaseDistance = 16.0f;   // distanza letta al livello 0 (texel trail)
+            int   speciesCount = kSpeciesCount;
+            // Moltiplicatori per specie: sensori (distanza, apertura), sterzata, velocita', deposito, boids, tinta
+            SimulationGPU::SpeciesSettings species[kSpeciesCount] = {
+                {},
+                {0.8f, 1.2f, 1.1f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.33f},
+                {1.3f, 0.8f, 0.9f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.66f},
+            };
+            bool  speciesChannels = false;       // un canale trail per specie + matrice di interazione
+            float speciesMatrix[kSpeciesCount][kSpeciesCount + 1] = {
+                {1.0f, 0.0f, 0.0f, 0.0f},
+                {0.0f, 1.0f, 0.0f, 0.0f},
+                {0.0f, 0.0f, 1.0f, 0.0f},
+            };
             float speedMin = 10.0f;
             float speedMax = 300.0f;
             float speed = 100.0f;
             float trailFade = 0.99f;
+            int   diffusionMode = 0;         // 0=Direct, 1=FFT GPU, 2=FFT CPU
+            int   diffusionRadius = 1;       // 1 = blur 3x3 originale
+            int   fftKernel = 0;             // 0=Gaussian, 1=Lenia ring
+            bool  leniaGrowth = false;
+            float leniaMu = 0.15f;
+            float leniaSigma = 0.015f;
+            float leniaDt = 0.1f;
             float toneExposure = 3.0f;
             float autoDimThreshold = 0.25f;
             float autoDimStrength = 0.5f;
@@ -188,6 +236,24 @@ int main(int argc, char **argv)
             // Collisions
             bool collisionsEnabled = false;
             float collisionRadius = 40.0f;
+
+            // Zone forces (densita' per specie a zone)
+            bool  zoneForces = false;
+            float zoneCellSize = 32.0f;
+            int   zoneRadius = 4;
+            float zoneStrength = 0.05f;
+            float zoneSpeciesForce[kSpeciesCount][2] = { {1.0f, 0.0f}, {0.0f, 1.0f}, {0.0f, -1.0f} };
+
+            // Reaction-diffusion (Gray-Scott)
+            bool  reactionEnabled = false;
+            float reactionFeed = 0.055f;
+            float reactionKill = 0.062f;
+            float reactionDiffU = 1.0f;
+            float reactionDiffV = 0.5f;
+            int   reactionSubsteps = 4;
+            float reactionDeposit = 0.05f;
+            float reactionSense = 1.0f;
+            float reactionOverlay = 0.5f;
             
             // Boundaries
             int boundaryMode = 0;
@@ -203,13 +269,35 @@ int main(int argc, char **argv)
             
             // Particles
             int targetParticleCount = 1000000;
+            int particleLayout = 0;   // 0 = standard 32 B, 1 = packed 16 B (stesso budget, doppie particelle), 2 = split
+            bool shaderVariants = true; // kernel di update specializzati sulle funzionalita' attive
+            uint32_t randomSeed = 1;  // seme di posizioni iniziali e stato PCG delle particelle
+            int seedDistribution = 0; // SimulationGPU::SeedDistribution delle particelle del ramp-up
+            std::string seedImage;    // PGM/PPM per la distribuzione Image; vuoto = semina dalla trail
+
+            // Emettitori (fuoco, pennacchi): popolazione con durata di vita al posto del ramp-up
+            bool emitters = false;
+            std::vector<SimulationGPU::ParticleEmitter> emitterList;
+
+            // Modalita' deterministica (interi, bit-identica tra esecuzioni e driver) per baseline di regressione
+            bool deterministic = false;
+            bool deterministicReference = false;   // riferimento CPU in lockstep, confronto degli hash
+            int  deterministicHashInterval = 600;  // passi tra due hash stampati
+
+            // Steady state: rallenta o ferma la simulazione quando il pattern non cambia piu'
+            bool  steadyDetect = false;
+            float steadyThreshold = 0.002f;  // variazione relativa di trail ed energia per campionamento
+            int   steadySamples = 30;        // campionamenti calmi consecutivi prima del throttle
+            int   steadyInterval = 8;        // step tra due campionamenti
+            int   steadyAction = 0;          // 0 = rallenta, 1 = pausa finche' non arriva input
+            int   steadyRateDivisor = 4;     // in rallentamento: 1 step ogni N
             
             // Texture / Resolution
             int resolutionPreset = 1; // 0=720, 1=1080, 2=1440, 3=4K
-            int textureFormat = 2;    // 0=R8, 1=RG8, 2=RGBA8
+            int textureFormat = 2;    // 0=R8, 1=RG8, 2=RGBA8, 3=R16F, 4=RG16F, 5=R11G11B10F, 6=RGBA16F
+            int trailScale = 0;       // 0=1:1, 1=1:2, 2=1:4 (risoluzione trail map rispetto alle particelle)
         } params;
         
-        constexpr int maxParticles = 5000000;
         const int defaultParticles = 1000000;
         params.targetParticleCount = defaultParticles;
 
@@ -229,6 +317,35 @@ int main(int argc, char **argv)
             std::cout << "[GPU] Attenzione: stai renderizzando con \"" << hardwareInfo.renderer
                       << "\" ma la GPU consigliata e' \"" << preferredGpu->name << "\"." << std::endl;
         }
+
+        // Budget di memoria per la simulazione: meta' della memoria libera riportata dal driver,
+        // altrimenti meta' della memoria dedicata DXGI (se stiamo davvero renderizzando su quella GPU)
+        const Utils::GpuMemoryInfo gpuMemory = Utils::queryGpuMemory();
+        uint64_t memoryBudget = 512ull * 1024 * 1024;
+        std::string memoryBudgetSource = "default";
+        if (memoryBudgetArg > 0) {
+            memoryBudget = static_cast<uint64_t>(memoryBudgetArg) * 1024 * 1024;
+            memoryBudgetSource = "--memory-budget";
+        } else if (gpuMemory.availableBytes > 0) {
+            memoryBudget = gpuMemory.availableBytes / 2;
+            memoryBudgetSource = gpuMemory.source;
+        } else if (usingPreferredGpu && preferredGpu->dedicatedMemory > 0) {
+            memoryBudget = preferredGpu->dedicatedMemory / 2;
+            memoryBudgetSource = "DXGI";
+        }
+        // Capacita' provvisoria (risoluzione di avvio), ricalcolata con quella del preset caricato
+        auto planCapacity = [&](int resolutionPreset, int textureFormat, int trailScale) {
+            if (maxParticlesArg > 0) {
+                return static_cast<int>(std::min<long long>(maxParticlesArg, SimulationGPU::kMaxParticleCapacity));
+            }
+            int width = 0, height = 0;
+            Utils::SimulationManager::getSimulationSize(static_cast<Utils::SimulationResolution>(resolutionPreset), width, height);
+            return std::max(SimulationGPU::kMinParticleCapacity,
+                            SimulationGPU::planParticleCapacity(memoryBudget, width, height,
+                                                                static_cast<SimulationGPU::TextureFormat>(textureFormat), 1 << trailScale));
+        };
+        int maxParticles = planCapacity(params.resolutionPreset, params.textureFormat, params.trailScale);
+
         const std::string hardwarePresetName = Utils::makeHardwarePresetName(hardwareInfo);
         const std::string hardwarePresetPath = configDir + "/" + hardwarePresetName + ".cfg";
         std::string currentPresetLabel = "default (non salvato)";
@@ -240,11 +357,41 @@ int main(int argc, char **argv)
             p.sensorDistance = std::clamp(p.sensorDistance, 1.0f, 500.0f);
             p.sensorAngle    = std::clamp(p.sensorAngle, 0.05f, 1.57f);
             p.turnAngle      = std::clamp(p.turnAngle, 0.05f, 1.57f);
+            p.reactionFeed = std::clamp(p.reactionFeed, 0.0f, 0.1f);
+            p.reactionKill = std::clamp(p.reactionKill, 0.0f, 0.1f);
+            p.reactionDiffU = std::clamp(p.reactionDiffU, 0.0f, 1.0f);
+            p.reactionDiffV = std::clamp(p.reactionDiffV, 0.0f, 1.0f);
+            p.reactionSubsteps = std::clamp(p.reactionSubsteps, 1, 16);
+            p.reactionDeposit = std::clamp(p.reactionDeposit, 0.0f, 1.0f);
+            p.reactionSense = std::clamp(p.reactionSense, -5.0f, 5.0f);
+            p.reactionOverlay = std::clamp(p.reactionOverlay, 0.0f, 2.0f);
+            p.pyramidBaseDistance = std::clamp(p.pyramidBaseDistance, 1.0f, 256.0f);
+            p.speciesCount = std::clamp(p.speciesCount, 1, kSpeciesCount);
+            for (auto& settings : p.species) {
+                settings.sensorScale = std::clamp(settings.sensorScale, 0.1f, 8.0f);
+                settings.sensorAngleScale = std::clamp(settings.sensorAngleScale, 0.1f, 4.0f);
+                settings.turnScale = std::clamp(settings.turnScale, 0.0f, 4.0f);
+                settings.speedScale = std::clamp(settings.speedScale, 0.1f, 4.0f);
+                settings.depositScale = std::clamp(settings.depositScale, 0.0f, 8.0f);
+                settings.alignmentScale = std::clamp(settings.alignmentScale, 0.0f, 4.0f);
+                settings.separationScale = std::clamp(settings.separationScale, 0.0f, 4.0f);
+                settings.cohesionScale = std::clamp(settings.cohesionScale, 0.0f, 4.0f);
+                settings.hueShift = std::clamp(settings.hueShift, 0.0f, 1.0f);
+            }
+            for (auto& row : p.speciesMatrix) {
+                for (float& weight : row) weight = std::clamp(weight, -4.0f, 4.0f);
+            }
             p.speedMin       = std::clamp(p.speedMin, 0.0f, kSpeedMaxCap);
             p.speedMax       = std::clamp(p.speedMax, p.speedMin + 1.0f, kSpeedMaxCap);
             p.speed          = std::clamp(p.speed, p.speedMin, p.speedMax);
             p.physarumIntensity = std::clamp(p.physarumIntensity, 0.0f, 5.0f);
             p.trailFade      = std::clamp(p.trailFade, 0.5f, 0.9999f);
+            p.diffusionMode  = std::clamp(p.diffusionMode, 0, static_cast<int>(SimulationGPU::DiffusionMode::Count) - 1);
+            p.diffusionRadius = std::clamp(p.diffusionRadius, 1, 256);
+            p.fftKernel      = std::clamp(p.fftKernel, 0, static_cast<int>(Fft::KernelType::Count) - 1);
+            p.leniaMu        = std::clamp(p.leniaMu, 0.0f, 1.0f);
+            p.leniaSigma     = std::clamp(p.leniaSigma, 0.001f, 0.5f);
+            p.leniaDt        = std::clamp(p.leniaDt, 0.0f, 1.0f);
             p.toneExposure   = std::clamp(p.toneExposure, 0.01f, 20.0f);
             p.autoDimThreshold = std::clamp(p.autoDimThreshold, 0.0f, 1.0f);
             p.autoDimStrength  = std::clamp(p.autoDimStrength, 0.0f, 1.0f);
@@ -258,9 +405,36 @@ int main(int argc, char **argv)
             p.restitution= std::clamp(p.restitution, 0.0f, 1.5f);
 
             p.collisionRadius = std::clamp(p.collisionRadius, 5.0f, 400.0f);
+            p.steadyThreshold = std::clamp(p.steadyThreshold, 1e-5f, 0.5f);
+            p.steadySamples = std::clamp(p.steadySamples, 1, 600);
+            p.steadyInterval = std::clamp(p.steadyInterval, 1, 120);
+            p.deterministicHashInterval = std::clamp(p.deterministicHashInterval, 1, 100000);
+            p.steadyAction = std::clamp(p.steadyAction, 0, 1);
+            p.steadyRateDivisor = std::clamp(p.steadyRateDivisor, 2, 60);
+            p.zoneCellSize = std::clamp(p.zoneCellSize, 4.0f, 256.0f);
+            p.zoneRadius = std::clamp(p.zoneRadius, 1, 64);
+            p.zoneStrength = std::clamp(p.zoneStrength, 0.0f, 1.0f);
+            for (auto& force : p.zoneSpeciesForce) {
+                force[0] = std::clamp(force[0], -4.0f, 4.0f);
+                force[1] = std::clamp(force[1], -4.0f, 4.0f);
+            }
             p.boundaryMode = std::clamp(p.boundaryMode, 0, 2);
             p.mouseMode = std::clamp(p.mouseMode, 0, 3);
-            p.targetParticleCount = std::clamp(p.targetParticleCount, 10000, maxParticles);
+            p.particleLayout = std::clamp(p.particleLayout, 0, static_cast<int>(ParticleLayout::Count) - 1);
+            p.seedDistribution = std::clamp(p.seedDistribution, 0, static_cast<int>(SimulationGPU::SeedDistribution::Count) - 1);
+            if (p.emitterList.size() > static_cast<size_t>(SimulationGPU::kMaxEmitters)) p.emitterList.resize(SimulationGPU::kMaxEmitters);
+            for (SimulationGPU::ParticleEmitter& e : p.emitterList) {
+                int shape = std::clamp(static_cast<int>(e.shape), 0, static_cast<int>(SimulationGPU::EmitterShape::Count) - 1);
+                e.shape = static_cast<SimulationGPU::EmitterShape>(shape);
+                for (float* v : { &e.x0, &e.y0, &e.x1, &e.y1 }) *v = std::clamp(*v, 0.0f, 1.0f);
+                e.rate = std::clamp(e.rate, 0.0f, 1.0e7f);
+                e.lifetimeMin = std::clamp(e.lifetimeMin, 0.0f, 600.0f);
+                e.lifetimeMax = std::clamp(e.lifetimeMax, e.lifetimeMin, 600.0f);
+                e.spread = std::clamp(e.spread, 0.0f, 6.2831853f);
+            }
+            const size_t layoutCapacity = static_cast<size_t>(maxParticles) * sizeof(GpuParticle)
+                                        / Particles::stride(static_cast<ParticleLayout>(p.particleLayout));
+            p.targetParticleCount = std::clamp(p.targetParticleCount, 10000, static_cast<int>(layoutCapacity));
             p.colorOffset = std::clamp(p.colorOffset, 0.0f, 1.0f);
             p.colorMode   = std::clamp(p.colorMode, 0, 4);
             p.neonSpeed   = std::clamp(p.neonSpeed, 0.0f, 10.0f);
@@ -279,7 +453,8 @@ int main(int argc, char **argv)
             p.mouseOscFreq = std::clamp(p.mouseOscFreq, 0.01f, 20.0f);
             p.mouseRingRadius = std::clamp(p.mouseRingRadius, 10.0f, 5000.0f);
             p.resolutionPreset = std::clamp(p.resolutionPreset, 0, 3);
-            p.textureFormat = std::clamp(p.textureFormat, 0, 2);
+            p.textureFormat = std::clamp(p.textureFormat, 0, static_cast<int>(SimulationGPU::TextureFormat::Count) - 1);
+            p.trailScale = std::clamp(p.trailScale, 0, 2);
         };
 
         auto saveParamsToFile = [&](const SimulationParams& p, const std::string& path) -> bool {
@@ -297,10 +472,35 @@ int main(int argc, char **argv)
                 out << "sensorDistance " << data.sensorDistance << "\n";
                 out << "sensorAngle " << data.sensorAngle << "\n";
                 out << "turnAngle " << data.turnAngle << "\n";
+                out << "samplerSensing " << (data.samplerSensing ? 1 : 0) << "\n";
+                out << "trailPyramid " << (data.trailPyramid ? 1 : 0) << "\n";
+                out << "pyramidBaseDistance " << data.pyramidBaseDistance << "\n";
+                out << "speciesCount " << data.speciesCount << "\n";
+                // species S sensore apertura sterzata velocita' deposito allineamento separazione coesione tinta
+                for (int s = 0; s < kSpeciesCount; ++s) {
+                    const auto& settings = data.species[s];
+                    out << "species " << s << " " << settings.sensorScale << " " << settings.sensorAngleScale
+                        << " " << settings.turnScale << " " << settings.speedScale << " " << settings.depositScale
+                        << " " << settings.alignmentScale << " " << settings.separationScale
+                        << " " << settings.cohesionScale << " " << settings.hueShift << "\n";
+                }
+                out << "speciesChannels " << (data.speciesChannels ? 1 : 0) << "\n";
+                out << "speciesMatrix";
+                for (const auto& row : data.speciesMatrix) {
+                    for (float weight : row) out << " " << weight;
+                }
+                out << "\n";
                 out << "speedMin " << data.speedMin << "\n";
                 out << "speedMax " << data.speedMax << "\n";
                 out << "speed " << data.speed << "\n";
                 out << "trailFade " << data.trailFade << "\n";
+                out << "diffusionMode " << data.diffusionMode << "\n";
+                out << "diffusionRadius " << data.diffusionRadius << "\n";
+                out << "fftKernel " << data.fftKernel << "\n";
+                out << "leniaGrowth " << (data.leniaGrowth ? 1 : 0) << "\n";
+                out << "leniaMu " << data.leniaMu << "\n";
+                out << "leniaSigma " << data.leniaSigma << "\n";
+                out << "leniaDt " << data.leniaDt << "\n";
                 out << "toneExposure " << data.toneExposure << "\n";
                 out << "autoDimThreshold " << data.autoDimThreshold << "\n";
                 out << "autoDimStrength " << data.autoDimStrength << "\n";
@@ -324,6 +524,28 @@ int main(int argc, char **argv)
                 out << "restitution " << data.restitution << "\n";
                 out << "collisionsEnabled " << (data.collisionsEnabled ? 1 : 0) << "\n";
                 out << "collisionRadius " << data.collisionRadius << "\n";
+                out << "steadyDetect " << (data.steadyDetect ? 1 : 0) << "\n";
+                out << "steadyThreshold " << data.steadyThreshold << "\n";
+                out << "steadySamples " << data.steadySamples << "\n";
+                out << "steadyInterval " << data.steadyInterval << "\n";
+                out << "steadyAction " << data.steadyAction << "\n";
+                out << "steadyRateDivisor " << data.steadyRateDivisor << "\n";
+                out << "zoneForces " << (data.zoneForces ? 1 : 0) << "\n";
+                out << "zoneCellSize " << data.zoneCellSize << "\n";
+                out << "zoneRadius " << data.zoneRadius << "\n";
+                out << "zoneStrength " << data.zoneStrength << "\n";
+                out << "zoneSpeciesForce";
+                for (const auto& force : data.zoneSpeciesForce) out << " " << force[0] << " " << force[1];
+                out << "\n";
+                out << "reactionEnabled " << (data.reactionEnabled ? 1 : 0) << "\n";
+                out << "reactionFeed " << data.reactionFeed << "\n";
+                out << "reactionKill " << data.reactionKill << "\n";
+                out << "reactionDiffU " << data.reactionDiffU << "\n";
+                out << "reactionDiffV " << data.reactionDiffV << "\n";
+                out << "reactionSubsteps " << data.reactionSubsteps << "\n";
+                out << "reactionDeposit " << data.reactionDeposit << "\n";
+                out << "reactionSense " << data.reactionSense << "\n";
+                out << "reactionOverlay " << data.reactionOverlay << "\n";
                 out << "boundaryMode " << data.boundaryMode << "\n";
                 out << "mouseMode " << data.mouseMode << "\n";
                 out << "mouseFalloff " << data.mouseFalloff << "\n";
@@ -333,8 +555,23 @@ int main(int argc, char **argv)
                 out << "mouseRingOverlay " << (data.mouseRingOverlay ? 1 : 0) << "\n";
                 out << "mouseRingRadius " << data.mouseRingRadius << "\n";
                 out << "targetParticleCount " << data.targetParticleCount << "\n";
+                out << "particleLayout " << data.particleLayout << "\n";
+                out << "shaderVariants " << (data.shaderVariants ? 1 : 0) << "\n";
+                out << "randomSeed " << data.randomSeed << "\n";
+                out << "seedDistribution " << data.seedDistribution << "\n";
+                if (!data.seedImage.empty()) out << "seedImage " << data.seedImage << "\n";
+                out << "emitters " << (data.emitters ? 1 : 0) << "\n";
+                // Un emettitore per riga: forma x0 y0 x1 y1 rate durataMin durataMax angolo apertura
+                for (const SimulationGPU::ParticleEmitter& e : data.emitterList) {
+                    out << "emitter " << static_cast<int>(e.shape) << " " << e.x0 << " " << e.y0 << " " << e.x1 << " " << e.y1
+                        << " " << e.rate << " " << e.lifetimeMin << " " << e.lifetimeMax << " " << e.angle << " " << e.spread << "\n";
+                }
+                out << "deterministic " << (data.deterministic ? 1 : 0) << "\n";
+                out << "deterministicReference " << (data.deterministicReference ? 1 : 0) << "\n";
+                out << "deterministicHashInterval " << data.deterministicHashInterval << "\n";
                 out << "resolutionPreset " << data.resolutionPreset << "\n";
                 out << "textureFormat " << data.textureFormat << "\n";
+                out << "trailScale " << data.trailScale << "\n";
                 return true;
             } catch (...) {
                 return false;
@@ -344,6 +581,10 @@ int main(int argc, char **argv)
         auto loadParamsFromFile = [&](SimulationParams& p, const std::string& path) -> bool {
             std::ifstream in(path);
             if (!in.is_open()) return false;
+            // Gli emettitori sono una lista: un preset senza righe "emitter" non ne ha
+            p.emitters = false;
+            p.emitterList.clear();
+            p.seedImage.clear();
             std::string line, key;
             while (std::getline(in, line)) {
                 std::istringstream iss(line);
@@ -353,10 +594,38 @@ int main(int argc, char **argv)
                 else if (key == "sensorDistance") iss >> p.sensorDistance;
                 else if (key == "sensorAngle") iss >> p.sensorAngle;
                 else if (key == "turnAngle") iss >> p.turnAngle;
+                else if (key == "samplerSensing") { int v; if (iss >> v) p.samplerSensing = (v != 0); }
+                else if (key == "trailPyramid") { int v; if (iss >> v) p.trailPyramid = (v != 0); }
+                else if (key == "pyramidBaseDistance") iss >> p.pyramidBaseDistance;
+                else if (key == "speciesSensorScale") { for (auto& settings : p.species) iss >> settings.sensorScale; }
+                else if (key == "speciesCount") iss >> p.speciesCount;
+                else if (key == "species") {
+                    int s;
+                    SimulationGPU::SpeciesSettings settings;
+                    if (iss >> s >> settings.sensorScale >> settings.sensorAngleScale >> settings.turnScale
+                            >> settings.speedScale >> settings.depositScale >> settings.alignmentScale
+                            >> settings.separationScale >> settings.cohesionScale >> settings.hueShift
+                        && s >= 0 && s < kSpeciesCount) {
+                        p.species[s] = settings;
+                    }
+                }
+                else if (key == "speciesChannels") { int v; if (iss >> v) p.speciesChannels = (v != 0); }
+                else if (key == "speciesMatrix") {
+                    for (auto& row : p.speciesMatrix) {
+                        for (float& weight : row) iss >> weight;
+                    }
+                }
                 else if (key == "speedMin") iss >> p.speedMin;
                 else if (key == "speedMax") iss >> p.speedMax;
                 else if (key == "speed") iss >> p.speed;
                 else if (key == "trailFade") iss >> p.trailFade;
+                else if (key == "diffusionMode") iss >> p.diffusionMode;
+                else if (key == "diffusionRadius") iss >> p.diffusionRadius;
+                else if (key == "fftKernel") iss >> p.fftKernel;
+                else if (key == "leniaGrowth") { int v; if (iss >> v) p.leniaGrowth = (v != 0); }
+                else if (key == "leniaMu") iss >> p.leniaMu;
+                else if (key == "leniaSigma") iss >> p.leniaSigma;
+                else if (key == "leniaDt") iss >> p.leniaDt;
                 else if (key == "toneExposure") iss >> p.toneExposure;
                 else if (key == "autoDimThreshold") iss >> p.autoDimThreshold;
                 else if (key == "autoDimStrength") iss >> p.autoDimStrength;
@@ -380,6 +649,28 @@ int main(int argc, char **argv)
                 else if (key == "restitution") iss >> p.restitution;
                 else if (key == "collisionsEnabled") { int v; if (iss >> v) p.collisionsEnabled = (v != 0); }
                 else if (key == "collisionRadius") iss >> p.collisionRadius;
+                else if (key == "steadyDetect") { int v; if (iss >> v) p.steadyDetect = (v != 0); }
+                else if (key == "steadyThreshold") iss >> p.steadyThreshold;
+                else if (key == "steadySamples") iss >> p.steadySamples;
+                else if (key == "steadyInterval") iss >> p.steadyInterval;
+                else if (key == "steadyAction") iss >> p.steadyAction;
+                else if (key == "steadyRateDivisor") iss >> p.steadyRateDivisor;
+                else if (key == "zoneForces") { int v; if (iss >> v) p.zoneForces = (v != 0); }
+                else if (key == "zoneCellSize") iss >> p.zoneCellSize;
+                else if (key == "zoneRadius") iss >> p.zoneRadius;
+                else if (key == "zoneStrength") iss >> p.zoneStrength;
+                else if (key == "zoneSpeciesForce") {
+                    for (auto& force : p.zoneSpeciesForce) iss >> force[0] >> force[1];
+                }
+                else if (key == "reactionEnabled") { int v; if (iss >> v) p.reactionEnabled = (v != 0); }
+                else if (key == "reactionFeed") iss >> p.reactionFeed;
+                else if (key == "reactionKill") iss >> p.reactionKill;
+                else if (key == "reactionDiffU") iss >> p.reactionDiffU;
+                else if (key == "reactionDiffV") iss >> p.reactionDiffV;
+                else if (key == "reactionSubsteps") iss >> p.reactionSubsteps;
+                else if (key == "reactionDeposit") iss >> p.reactionDeposit;
+                else if (key == "reactionSense") iss >> p.reactionSense;
+                else if (key == "reactionOverlay") iss >> p.reactionOverlay;
                 else if (key == "boundaryMode") iss >> p.boundaryMode;
                 else if (key == "mouseMode") iss >> p.mouseMode;
                 else if (key == "mouseFalloff") iss >> p.mouseFalloff;
@@ -389,8 +680,26 @@ int main(int argc, char **argv)
                 else if (key == "mouseRingOverlay") { int v; if (iss >> v) p.mouseRingOverlay = (v != 0); }
                 else if (key == "mouseRingRadius") iss >> p.mouseRingRadius;
                 else if (key == "targetParticleCount") iss >> p.targetParticleCount;
+                else if (key == "particleLayout") iss >> p.particleLayout;
+                else if (key == "shaderVariants") { int v; if (iss >> v) p.shaderVariants = (v != 0); }
+                else if (key == "randomSeed") iss >> p.randomSeed;
+                else if (key == "seedDistribution") iss >> p.seedDistribution;
+                else if (key == "seedImage") std::getline(iss >> std::ws, p.seedImage);   // il percorso puo' contenere spazi
+                else if (key == "emitters") { int v; if (iss >> v) p.emitters = (v != 0); }
+                else if (key == "emitter") {
+                    SimulationGPU::ParticleEmitter e;
+                    int shape = 0;
+                    if (iss >> shape >> e.x0 >> e.y0 >> e.x1 >> e.y1 >> e.rate >> e.lifetimeMin >> e.lifetimeMax >> e.angle >> e.spread) {
+                        e.shape = static_cast<SimulationGPU::EmitterShape>(shape);
+                        p.emitterList.push_back(e);
+                    }
+                }
+                else if (key == "deterministic") { int v; if (iss >> v) p.deterministic = (v != 0); }
+                else if (key == "deterministicReference") { int v; if (iss >> v) p.deterministicReference = (v != 0); }
+                else if (key == "deterministicHashInterval") iss >> p.deterministicHashInterval;
                 else if (key == "resolutionPreset") iss >> p.resolutionPreset;
                 else if (key == "textureFormat") iss >> p.textureFormat;
+                else if (key == "trailScale") iss >> p.trailScale;
             }
             clampParams(p);
             return true;
@@ -412,14 +721,48 @@ int main(int argc, char **argv)
             clampParams(params);
             presetStatus = "Usando impostazioni di default hardcoded";
         }
+        if (!seedImageArg.empty()) {
+            params.seedImage = seedImageArg;
+            params.seedDistribution = static_cast<int>(SimulationGPU::SeedDistribution::Image);
+        }
+
+        // Trail e griglia alla risoluzione scelta dal preset escono dal budget prima delle particelle
+        maxParticles = planCapacity(params.resolutionPreset, params.textureFormat, params.trailScale);
+        clampParams(params);
+        {
+            int width = 0, height = 0;
+            Utils::SimulationManager::getSimulationSize(static_cast<Utils::SimulationResolution>(params.resolutionPreset), width, height);
+            const size_t fieldBytes = SimulationGPU::estimateFieldMemoryBytes(
+                width, height, static_cast<SimulationGPU::TextureFormat>(params.textureFormat), 1 << params.trailScale);
+            std::cout << "[Particles] Budget " << Utils::formatMemoryMB(memoryBudget) << " (" << memoryBudgetSource
+                      << "), trail/griglia " << Utils::formatMemoryMB(fieldBytes) << " a " << width << "x" << height
+                      << ": capacita' " << maxParticles << " particelle"
+                      << (maxParticlesArg > 0 ? " (--max-particles)" : "") << std::endl;
+        }
+
+        // Binari dei programmi GLSL: il primo avvio (o un driver nuovo) compila, i successivi caricano
+        ProgramCache::setDirectory("shader_cache");
+        ProgramCache::resetStats();
 
         SimulationGPU simulation(maxParticles, simWidth, simHeight);
+        simulation.setParticleLayout(static_cast<ParticleLayout>(params.particleLayout));
+        simulation.setRandomSeed(params.randomSeed);
         simulation.initialize();
+        // Il driver puo' rifiutare il layout richiesto (limite di SSBO): la UI mostra quello in uso
+        params.particleLayout = static_cast<int>(simulation.getParticleLayout());
         simulation.setActiveParticleCount(params.targetParticleCount);
 
         //// 4. RENDER PIPELINE
         RenderPipeline renderPipeline(simWidth, simHeight);
         renderPipeline.initialize();
+
+        // Avvio a cache calda (tutti caricati) o fredda (compilati dai sorgenti)
+        const ProgramCache::Stats shaderStartup = ProgramCache::stats();
+        std::cout << "[Shaders] " << (shaderStartup.loaded + shaderStartup.compiled) << " programmi in "
+                  << shaderStartup.ms << " ms (cache " << (shaderStartup.compiled == 0 ? "calda" : "fredda")
+                  << ": " << shaderStartup.loaded << " caricati, " << shaderStartup.compiled << " compilati"
+                  << (ProgramCache::hasParallelCompile() ? ", compilazione parallela" : "")
+                  << (ProgramCache::isEnabled() ? "" : ", cache non disponibile") << ")" << std::endl;
        
         //// 5. TIMESTEPPER
         Utils::TimestepManager timeStepper(1.0/60.0);
@@ -429,10 +772,33 @@ int main(int argc, char **argv)
         // UI State
         bool showMenu = false;
 
+        // Benchmark dei formati trail: cicla tutti i formati e raccoglie i tempi medi a regime
+        struct FormatBenchmark {
+            bool running = false;
+            int  current = 0;
+            int  savedFormat = 0;
+        } formatBench;
+        constexpr int kFormatBenchSamples = 120;
+
+        // Immagine di semina in GPU: ricaricata quando params.seedImage cambia (preset o --seed-image)
+        std::string loadedSeedImage;
+        int seedImageWidth = 0, seedImageHeight = 0;
+
+        // Stato stazionario: dopo steadySamples campionamenti calmi consecutivi la simulazione
+        // rallenta o si ferma; qualunque input (mouse, tastiera, UI) la riporta a piena velocita'
+        struct SteadyStateGovernor {
+            int  calmSamples = 0;
+            int  lastSample = 0;
+            bool throttled = false;
+            int  skippedSteps = 0;
+        } steady;
+
         //// 6. MAIN LOOP
         while (!windowManager.shouldClose())
         {
-            glfwPollEvents();
+            // In pausa per stato stazionario il loop aspetta gli eventi invece di girare a vuoto
+            if (steady.throttled && params.steadyAction == 1) glfwWaitEventsTimeout(0.25);
+            else glfwPollEvents();
 
             // --- IMGUI FRAME ---
             ImGui_ImplOpenGL3_NewFrame();
@@ -531,6 +897,14 @@ int main(int argc, char **argv)
                     
                     ImGui::Spacing();
                     ImGui::TextColored(ImVec4(0.60f, 0.65f, 0.72f, 1.0f), "FPS: %.1f  |  %.2f ms", io.Framerate, 1000.0f / io.Framerate);
+                    // Ultimi tempi GPU per passo accanto al costo CPU medio di update() (preparazione e invio dei comandi)
+                    ImGui::TextColored(ImVec4(0.60f, 0.65f, 0.72f, 1.0f), "GPU: grid %.2f | update %.2f | blur %.2f ms",
+                                       simulation.getLastGridMs(), simulation.getLastUpdateMs(), simulation.getLastBlurMs());
+                    if (simulation.isEmittersEnabled()) {
+                        ImGui::SameLine();
+                        ImGui::TextColored(ImVec4(0.60f, 0.65f, 0.72f, 1.0f), "| emitters %.2f ms", simulation.getLastEmitterMs());
+                    }
+                    ImGui::TextColored(ImVec4(0.60f, 0.65f, 0.72f, 1.0f), "CPU submit: %.3f ms / step", simulation.getSubmitMs());
                     ImGui::Spacing();
                     ImGui::Separator();
                     ImGui::Spacing();
@@ -570,11 +944,55 @@ int main(int argc, char **argv)
                             {
                                 ImGui::TextColored(ImVec4(0.8f,0.5f,0.5f,1.0f), "GPU preferita non rilevata");
                             }
+
+                            ImGui::Spacing();
+                            ImGui::TextColored(ImVec4(0.6f,0.7f,0.8f,1.0f), "Shader all'avvio:");
+                            ImGui::Text("%d programmi in %.1f ms (cache %s)", shaderStartup.loaded + shaderStartup.compiled,
+                                        shaderStartup.ms, shaderStartup.compiled == 0 ? "calda" : "fredda");
+                            ImGui::TextColored(ImVec4(0.6f,0.6f,0.6f,1.0f), "%d caricati, %d compilati%s", shaderStartup.loaded,
+                                               shaderStartup.compiled, ProgramCache::hasParallelCompile() ? ", in parallelo" : "");
+
+                            // Tempi GPU per pass del grafo (solo i pass eseguiti in quel passo)
+                            ImGui::Spacing();
+                            const PassGraph& passGraph = simulation.getPassGraph();
+                            ImGui::TextColored(ImVec4(0.6f,0.7f,0.8f,1.0f), "Pass GPU (%d barriere / passo):", passGraph.getLastBarrierCount());
+                            for (int pass = 0; pass < passGraph.passCount(); ++pass)
+                            {
+                                if (!passGraph.passRan(pass)) continue;
+                                ImGui::Text("  %-10s %.3f ms", passGraph.passName(pass), passGraph.passMs(pass));
+                            }
                             ImGui::PopTextWrapPos();
                             ImGui::Spacing();
                             ImGui::TreePop();
                         }
 
+                        // Power saving
+                        if (ImGui::TreeNodeEx("Steady State"))
+                        {
+                            ImGui::Checkbox("Detect Steady State", &params.steadyDetect);
+                            if (ImGui::IsItemHovered()) ImGui::SetTooltip("Riduzione GPU ogni N step: variazione per tile della trail ed energia delle particelle.\nSotto soglia per abbastanza campionamenti la simulazione rallenta o si ferma fino al prossimo input.");
+                            ImGui::SliderFloat("Threshold", &params.steadyThreshold, 1e-4f, 0.05f, "%.4f", ImGuiSliderFlags_Logarithmic);
+                            ImGui::SliderInt("Calm Samples", &params.steadySamples, 1, 120);
+                            ImGui::SliderInt("Check Every (steps)", &params.steadyInterval, 1, 60);
+                            static const char* steadyActions[] = { "Reduce Rate", "Pause Until Input" };
+                            ImGui::Combo("Action", &params.steadyAction, steadyActions, IM_ARRAYSIZE(steadyActions));
+                            if (params.steadyAction == 0) {
+                                ImGui::SliderInt("Rate Divisor", &params.steadyRateDivisor, 2, 30);
+                            }
+                            if (params.steadyDetect) {
+                                const auto& activity = simulation.getActivityMetrics();
+                                ImGui::TextDisabled("Trail %.5f | Energy %.5f | calm %d/%d",
+                                    activity.trailChange, activity.energyChange, steady.calmSamples, params.steadySamples);
+                                if (steady.throttled) {
+                                    ImGui::TextColored(ImVec4(0.95f,0.75f,0.35f,1.0f), params.steadyAction == 1 ? "Stazionario: in pausa" : "Stazionario: rallentato");
+                                } else {
+                                    ImGui::TextColored(ImVec4(0.6f,0.9f,0.6f,1.0f), "Attivo");
+                                }
+                            }
+                            ImGui::Spacing();
+                            ImGui::TreePop();
+                        }
+
                         // Preset management
                         if (ImGui::TreeNodeEx("Presets"))
                         {
@@ -700,6 +1118,109 @@ int main(int argc, char **argv)
                         params.targetParticleCount = std::clamp(params.targetParticleCount, 10000, maxCount);
                         ImGui::TextColored(ImVec4(0.7f, 0.8f, 0.7f, 1.0f), "Particles");
                         ImGui::SliderInt("##ParticleCount", &params.targetParticleCount, 10000, maxCount, "%d", ImGuiSliderFlags_AlwaysClamp);
+
+                        // Layout dei record: il budget di memoria e' fisso, il layout compatto raddoppia il massimo
+                        const char* layoutOptions[static_cast<int>(ParticleLayout::Count)];
+                        for (int i = 0; i < static_cast<int>(ParticleLayout::Count); ++i) {
+                            layoutOptions[i] = Particles::label(static_cast<ParticleLayout>(i));
+                        }
+                        ImGui::Combo("Layout##Particles", &params.particleLayout, layoutOptions, IM_ARRAYSIZE(layoutOptions));
+                        if (ImGui::IsItemHovered()) {
+                            ImGui::SetTooltip("Cambiare layout ricrea i buffer e riparte dal ramp-up");
+                        }
+                        ImGui::TextDisabled("%.0f MB di buffer particelle (%s), max %d",
+                                            simulation.getParticleBufferBytes() / (1024.0 * 1024.0),
+                                            simulation.isParticleDoubleBuffered() ? "double buffer" : "in place", maxCount);
+
+                        ImGui::Checkbox("Kernel specializzati", &params.shaderVariants);
+                        if (ImGui::IsItemHovered()) {
+                            ImGui::SetTooltip("Update compilato per le funzionalita' attive (bordi, forze, mouse, colore):\n"
+                                              "i rami spenti spariscono. Ogni combinazione nuova compila in background,\n"
+                                              "nel frattempo gira il kernel generico");
+                        }
+                        if (params.shaderVariants) {
+                            ImGui::SameLine();
+                            ImGui::TextDisabled("%s, %d in cache", simulation.isUpdateVariantActive() ? "attivo" : "in compilazione",
+                                                simulation.getUpdateVariantCount());
+                        }
+
+                        // Seme: Restart azzera trail e campo e ripete la stessa sequenza casuale
+                        ImGui::SetNextItemWidth(120.0f);
+                        ImGui::InputScalar("Seed##Particles", ImGuiDataType_U32, &params.randomSeed);
+                        ImGui::SameLine();
+                        if (ImGui::Button("Restart##Seed")) {
+                            simulation.setRandomSeed(params.randomSeed);
+                        }
+                        const char* seedOptions[] = { "Center burst", "Uniform", "Ring", "Image" };
+                        ImGui::Combo("Spawn##Seed", &params.seedDistribution, seedOptions, IM_ARRAYSIZE(seedOptions));
+                        if (ImGui::IsItemHovered()) {
+                            ImGui::SetTooltip("Dove nascono le particelle del ramp-up (semina in GPU). Image: dove l'immagine e' piu' luminosa\n"
+                                              "(--seed-image FILE.pgm/.ppm o seedImage nel preset); senza immagine dove lo e' la trail");
+                        }
+                        if (params.seedDistribution == static_cast<int>(SimulationGPU::SeedDistribution::Image)) {
+                            if (seedImageWidth > 0) {
+                                ImGui::TextDisabled("%s (%dx%d)", std::filesystem::path(loadedSeedImage).filename().string().c_str(),
+                                                    seedImageWidth, seedImageHeight);
+                            } else {
+                                ImGui::TextDisabled("Nessuna immagine: semina dalla trail");
+                            }
+                        }
+
+                        // Emettitori: il numero di particelle sopra diventa il tetto della popolazione
+                        ImGui::Checkbox("Emitters##Particles", &params.emitters);
+                        if (ImGui::IsItemHovered()) {
+                            ImGui::SetTooltip("Particelle con durata di vita nate dagli emettitori; le morte sono compattate in GPU.\n"
+                                              "Il conteggio delle vive resta in GPU (dispatch indiretti): il numero sopra e' il tetto.");
+                        }
+                        if (params.emitters) {
+                            const char* shapeOptions[] = { "Point", "Line", "Region" };
+                            int removeIndex = -1;
+                            for (size_t i = 0; i < params.emitterList.size(); ++i) {
+                                SimulationGPU::ParticleEmitter& e = params.emitterList[i];
+                                ImGui::PushID(static_cast<int>(i));
+                                int shape = static_cast<int>(e.shape);
+                                ImGui::SetNextItemWidth(90.0f);
+                                if (ImGui::Combo("##Shape", &shape, shapeOptions, IM_ARRAYSIZE(shapeOptions))) {
+                                    e.shape = static_cast<SimulationGPU::EmitterShape>(shape);
+                                }
+                                ImGui::SameLine();
+                                if (ImGui::SmallButton("Remove")) removeIndex = static_cast<int>(i);
+                                ImGui::DragFloat2("Position", &e.x0, 0.005f, 0.0f, 1.0f, "%.3f");
+                                if (e.shape != SimulationGPU::EmitterShape::Point) {
+                                    ImGui::DragFloat2(e.shape == SimulationGPU::EmitterShape::Line ? "End" : "Corner", &e.x1, 0.005f, 0.0f, 1.0f, "%.3f");
+                                }
+                                ImGui::DragFloat("Rate/s", &e.rate, 100.0f, 0.0f, 1.0e7f, "%.0f");
+                                ImGui::DragFloatRange2("Lifetime s", &e.lifetimeMin, &e.lifetimeMax, 0.05f, 0.0f, 600.0f, "%.2f");
+                                ImGui::SliderAngle("Angle", &e.angle, -180.0f, 180.0f);
+                                ImGui::SliderAngle("Spread", &e.spread, 0.0f, 360.0f);
+                                ImGui::Separator();
+                                ImGui::PopID();
+                            }
+                            if (removeIndex >= 0) params.emitterList.erase(params.emitterList.begin() + removeIndex);
+                            if (params.emitterList.size() < static_cast<size_t>(SimulationGPU::kMaxEmitters) && ImGui::Button("Add emitter")) {
+                                params.emitterList.push_back(SimulationGPU::ParticleEmitter{});
+                            }
+                        }
+
+                        // Deterministica: stesso seme e parametri -> stessi hash su ogni macchina
+                        ImGui::Checkbox("Deterministic##Particles", &params.deterministic);
+                        if (ImGui::IsItemHovered()) {
+                            ImGui::SetTooltip("Physarum intero (16.16, depositi atomici uint): boids, mouse, zone e reazione ignorati");
+                        }
+                        if (params.deterministic) {
+                            ImGui::SameLine();
+                            ImGui::Checkbox("CPU check##Deterministic", &params.deterministicReference);
+                            ImGui::SetNextItemWidth(120.0f);
+                            ImGui::InputInt("Hash every##Deterministic", &params.deterministicHashInterval);
+                            params.deterministicHashInterval = std::clamp(params.deterministicHashInterval, 1, 100000);
+                            if (simulation.getDeterministicHash() != 0) {
+                                ImVec4 color = simulation.isDeterministicDiverged() ? ImVec4(1.0f, 0.4f, 0.4f, 1.0f)
+                                                                                    : ImVec4(0.6f, 0.8f, 0.6f, 1.0f);
+                                ImGui::TextColored(color, "step %u  0x%016llx%s", simulation.getDeterministicStep(),
+                                                   static_cast<unsigned long long>(simulation.getDeterministicHash()),
+                                                   simulation.isDeterministicDiverged() ? "  DIVERGED" : "");
+                            }
+                        }
                         
                         ImGui::Spacing();
                         // --- Boundary ---
@@ -723,7 +1244,78 @@ int main(int argc, char **argv)
                             if (params.physarumEnabled) {
                                 ImGui::Spacing();
                                 ImGui::SliderFloat("Force Intensity", &params.physarumIntensity, 0.0f, 5.0f, "%.2f");
-                                ImGui::SliderFloat("Sensor Distance", &params.sensorDistance, 5.0f, 50.0f, "%.1f px");
+                                // Con la piramide i sensori lontani costano quanto quelli vicini: range esteso
+                                const float maxSensorDistance = params.trailPyramid ? 400.0f : 50.0f;
+                                ImGui::SliderFloat("Sensor Distance", &params.sensorDistance, 5.0f, maxSensorDistance, "%.1f px");
+                                ImGui::Checkbox("Sampler Sensing", &params.samplerSensing);
+                                if (ImGui::IsItemHovered()) {
+                                    ImGui::SetTooltip("On: sensori sul frame precedente (sampler bilineare)\nOff: imageLoad sulla trail in scrittura (legacy)");
+                                }
+                                {
+                                    const auto& imageTiming = simulation.getSensingTiming(false);
+                                    const auto& samplerTiming = simulation.getSensingTiming(true);
+                                    ImGui::TextDisabled("Update: image %.3f ms (%d) | sampler %.3f ms (%d)",
+                                                        imageTiming.updateMs, imageTiming.samples,
+                                                        samplerTiming.updateMs, samplerTiming.samples);
+                                    ImGui::SameLine();
+                                    if (ImGui::SmallButton("Reset##SensingTiming")) {
+                                        simulation.resetSensingTiming();
+                                    }
+                                }
+                                ImGui::Checkbox("Multi-scale Sensing", &params.trailPyramid);
+                                if (params.trailPyramid) {
+                                    ImGui::SliderFloat("Pyramid Base Dist", &params.pyramidBaseDistance, 4.0f, 64.0f, "%.0f px");
+                                    ImGui::TextDisabled("Livelli trail: %d", simulation.getTrailLevels());
+                                }
+                                ImGui::SliderInt("Species", &params.speciesCount, 1, kSpeciesCount);
+                                for (int species = 0; species < params.speciesCount; ++species) {
+                                    char label[32];
+                                    std::snprintf(label, sizeof(label), "Species S%d", species);
+                                    if (ImGui::TreeNode(label)) {
+                                        auto& settings = params.species[species];
+                                        ImGui::SliderFloat("Sensor Dist", &settings.sensorScale, 0.25f, 4.0f, "%.2fx");
+                                        ImGui::SliderFloat("Sensor Angle", &settings.sensorAngleScale, 0.25f, 2.0f, "%.2fx");
+                                        ImGui::SliderFloat("Turn", &settings.turnScale, 0.0f, 2.0f, "%.2fx");
+                                        ImGui::SliderFloat("Speed", &settings.speedScale, 0.25f, 2.0f, "%.2fx");
+                                        ImGui::SliderFloat("Deposit", &settings.depositScale, 0.0f, 4.0f, "%.2fx");
+                                        ImGui::SliderFloat("Hue Shift", &settings.hueShift, 0.0f, 1.0f, "%.2f");
+                                        if (params.boidsEnabled) {
+                                            ImGui::SliderFloat("Alignment", &settings.alignmentScale, 0.0f, 2.0f, "%.2fx");
+                                            ImGui::SliderFloat("Separation", &settings.separationScale, 0.0f, 2.0f, "%.2fx");
+                                            ImGui::SliderFloat("Cohesion", &settings.cohesionScale, 0.0f, 2.0f, "%.2fx");
+                                        }
+                                        ImGui::TreePop();
+                                    }
+                                }
+
+                                ImGui::Checkbox("Species Channels", &params.speciesChannels);
+                                if (params.speciesChannels) {
+                                    if (!simulation.isSpeciesChannelsActive()) {
+                                        ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.2f, 1.0f), "Serve un formato a 3+ canali (RGBA8, R11G11B10F, RGBA16F)");
+                                    }
+                                    // Riga = specie che sente, colonne = traccia delle specie S0..S2 + densita' totale
+                                    if (ImGui::BeginTable("SpeciesMatrix", kSpeciesCount + 2, ImGuiTableFlags_SizingFixedFit)) {
+                                        ImGui::TableSetupColumn("");
+                                        ImGui::TableSetupColumn("S0");
+                                        ImGui::TableSetupColumn("S1");
+                                        ImGui::TableSetupColumn("S2");
+                                        ImGui::TableSetupColumn("Tot");
+                                        ImGui::TableHeadersRow();
+                                        for (int species = 0; species < kSpeciesCount; ++species) {
+                                            ImGui::TableNextRow();
+                                            ImGui::TableNextColumn();
+                                            ImGui::Text("S%d", species);
+                                            for (int column = 0; column <= kSpeciesCount; ++column) {
+                                                ImGui::TableNextColumn();
+                                                ImGui::PushID(species * (kSpeciesCount + 1) + column);
+                                                ImGui::SetNextItemWidth(48.0f);
+                                                ImGui::DragFloat("##w", &params.speciesMatrix[species][column], 0.01f, -4.0f, 4.0f, "%.2f");
+                                                ImGui::PopID();
+                                            }
+                                        }
+                                        ImGui::EndTable();
+                                    }
+                                }
                                 
                                 float sensorDeg = params.sensorAngle * 57.2958f;
                                 if (ImGui::SliderFloat("Sensor Angle", &sensorDeg, 5.0f, 90.0f, "%.1f deg")) {
@@ -793,6 +1385,57 @@ int main(int argc, char **argv)
 
                         ImGui::Spacing();
 
+                        // --- Reaction-Diffusion ---
+                        ImGui::Checkbox("Reaction", &params.reactionEnabled);
+                        ImGui::SameLine();
+                        if (ImGui::TreeNode("Settings##Reaction"))
+                        {
+                            ImGui::Spacing();
+                            ImGui::SliderFloat("Feed", &params.reactionFeed, 0.0f, 0.1f, "%.4f");
+                            ImGui::SliderFloat("Kill", &params.reactionKill, 0.0f, 0.1f, "%.4f");
+                            ImGui::SliderFloat("Diffusion U", &params.reactionDiffU, 0.0f, 1.0f, "%.2f");
+                            ImGui::SliderFloat("Diffusion V", &params.reactionDiffV, 0.0f, 1.0f, "%.2f");
+                            ImGui::SliderInt("Substeps", &params.reactionSubsteps, 1, 16);
+                            ImGui::SliderFloat("Particle Feed", &params.reactionDeposit, 0.0f, 0.5f, "%.3f");
+                            ImGui::SliderFloat("Sense V", &params.reactionSense, -5.0f, 5.0f, "%.2f");
+                            ImGui::SliderFloat("Overlay", &params.reactionOverlay, 0.0f, 2.0f, "%.2f");
+                            if (ImGui::Button("Reset Field")) {
+                                simulation.resetReactionField();
+                            }
+                            ImGui::SameLine();
+                            ImGui::TextDisabled("%.3f ms", simulation.getLastReactionMs());
+                            ImGui::Spacing();
+                            ImGui::TreePop();
+                        }
+
+                        ImGui::Spacing();
+
+                        // --- Zone Forces ---
+                        ImGui::Checkbox("Zone Forces", &params.zoneForces);
+                        if (ImGui::IsItemHovered()) ImGui::SetTooltip("Forze deboli a zone, proporzionali alla presenza di ogni specie.\nDensita' per specie ridotta ogni step in una summed-area table GPU.");
+                        ImGui::SameLine();
+                        if (ImGui::TreeNode("Settings##Zones"))
+                        {
+                            ImGui::Spacing();
+                            ImGui::SliderFloat("Cell Size", &params.zoneCellSize, 8.0f, 128.0f, "%.0f px");
+                            ImGui::SliderInt("Zone Radius", &params.zoneRadius, 1, 32);
+                            if (ImGui::IsItemHovered()) ImGui::SetTooltip("Semilato della zona in celle: il costo per particella non dipende dal raggio");
+                            ImGui::SliderFloat("Strength", &params.zoneStrength, 0.0f, 0.5f, "%.3f");
+                            static const char* zoneSpeciesLabels[kSpeciesCount] = { "Species 0", "Species 1", "Species 2" };
+                            for (int s = 0; s < kSpeciesCount; ++s) {
+                                ImGui::PushID(s);
+                                ImGui::TextUnformatted(zoneSpeciesLabels[s]);
+                                ImGui::SliderFloat("Attract", &params.zoneSpeciesForce[s][0], -2.0f, 2.0f, "%.2f");
+                                ImGui::SliderFloat("Swirl", &params.zoneSpeciesForce[s][1], -2.0f, 2.0f, "%.2f");
+                                ImGui::PopID();
+                            }
+                            ImGui::TextDisabled("Zone grid: %d x %d", simulation.getZoneGridWidth(), simulation.getZoneGridHeight());
+                            ImGui::Spacing();
+                            ImGui::TreePop();
+                        }
+
+                        ImGui::Spacing();
+
                         // (Boundary moved up)
                         ImGui::Spacing();
                         
@@ -810,12 +1453,62 @@ int main(int argc, char **argv)
 
                         // 1. Texture Settings
                         if (ImGui::TreeNodeEx("Texture Settings")) {
-                             const char* fmtItems[] = { "R8 (1 Ch: Low Bandwidth)", "RG8 (2 Ch: Medium)", "RGBA8 (4 Ch: Standard)" };
+                             const char* fmtItems[] = { "R8 (1 Ch: Low Bandwidth)", "RG8 (2 Ch: Medium)", "RGBA8 (4 Ch: Standard)",
+                                                        "R16F (1 Ch: HDR Density)", "RG16F (2 Ch: HDR)", "R11G11B10F (3 Ch: HDR Color)", "RGBA16F (4 Ch: HDR Full)" };
+                             ImGui::BeginDisabled(formatBench.running);
                              ImGui::Combo("Format", &params.textureFormat, fmtItems, IM_ARRAYSIZE(fmtItems));
-                             if (ImGui::IsItemHovered()) ImGui::SetTooltip("R8=Solo Rosso (veloce), RG8=Rosso+Verde, RGBA8=Full Pixel Color");
+                             ImGui::EndDisabled();
+                             if (ImGui::IsItemHovered()) ImGui::SetTooltip("R8=Solo Rosso (veloce), RG8=Rosso+Verde, RGBA8=Full Pixel Color\n16F/11F=Float: niente saturazione a 1.0 e scie lunghe senza quantizzazione");
+
+                             // Costo memoria/banda per formato (tempi misurati a regime)
+                             if (ImGui::BeginTable("FormatCost", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+                                 ImGui::TableSetupColumn("Formato");
+                                 ImGui::TableSetupColumn("Memoria");
+                                 ImGui::TableSetupColumn("Update");
+                                 ImGui::TableSetupColumn("Blur");
+                                 ImGui::TableHeadersRow();
+                                 for (int f = 0; f < static_cast<int>(SimulationGPU::TextureFormat::Count); ++f) {
+                                     auto fmt = static_cast<SimulationGPU::TextureFormat>(f);
+                                     const auto& info = SimulationGPU::getTextureFormatInfo(fmt);
+                                     const auto& timing = simulation.getFormatTiming(fmt);
+                                     ImGui::TableNextRow();
+                                     ImGui::TableNextColumn();
+                                     if (f == params.textureFormat) ImGui::TextColored(ImVec4(0.6f,0.9f,0.6f,1.0f), "%s", info.label);
+                                     else ImGui::Text("%s", info.label);
+                                     ImGui::TableNextColumn();
+                                     ImGui::Text("%s", Utils::formatMemoryMB(simulation.getTrailMemoryBytes(fmt)).c_str());
+                                     ImGui::TableNextColumn();
+                                     if (timing.samples > 0) ImGui::Text("%.2f ms", timing.updateMs); else ImGui::TextDisabled("-");
+                                     ImGui::TableNextColumn();
+                                     if (timing.samples > 0) ImGui::Text("%.2f ms", timing.blurMs); else ImGui::TextDisabled("-");
+                                 }
+                                 ImGui::EndTable();
+                             }
+                             if (!formatBench.running) {
+                                 if (ImGui::Button("Benchmark formati", ImVec2(220, 40))) {
+                                     formatBench.running = true;
+                                     formatBench.current = 0;
+                                     formatBench.savedFormat = params.textureFormat;
+                                     params.textureFormat = 0;
+                                     simulation.resetFormatTiming(SimulationGPU::TextureFormat::R8);
+                                 }
+                                 if (ImGui::IsItemHovered()) ImGui::SetTooltip("Prova ogni formato a regime e misura i tempi GPU di update e blur");
+                             } else {
+                                 ImGui::TextColored(ImVec4(0.95f,0.75f,0.35f,1.0f), "Benchmark in corso: %s (%d/%d)",
+                                     SimulationGPU::getTextureFormatInfo(static_cast<SimulationGPU::TextureFormat>(formatBench.current)).label,
+                                     formatBench.current + 1, static_cast<int>(SimulationGPU::TextureFormat::Count));
+                             }
+                             if (simulation.isRampingUp()) {
+                                 ImGui::TextDisabled("Ramp-up in corso: tempi non ancora misurati");
+                             }
                              
                              const char* resItems[] = { "720p (HD)", "1080p (FHD)", "1440p (QHD)", "2160p (4K)" };
                              ImGui::Combo("Resolution", &params.resolutionPreset, resItems, IM_ARRAYSIZE(resItems));
+
+                             const char* trailItems[] = { "Full (1:1)", "Half (1:2)", "Quarter (1:4)" };
+                             ImGui::Combo("Trail Resolution", &params.trailScale, trailItems, IM_ARRAYSIZE(trailItems));
+                             if (ImGui::IsItemHovered()) ImGui::SetTooltip("Riduce solo la trail map (blur e banda), le particelle restano alla risoluzione piena.\nDepositi e sensori in bilineare, il pass finale scala l'immagine.");
+                             ImGui::TextColored(ImVec4(0.6f,0.7f,0.8f,1.0f), "Trail map: %d x %d", simulation.getTrailWidth(), simulation.getTrailHeight());
                              
                              ImGui::TreePop();
                              ImGui::Separator();
@@ -831,6 +1524,66 @@ int main(int argc, char **argv)
                             ImGui::SliderFloat("Trail Decay", &params.trailFade, 0.90f, 0.9999f, "%.4f");
                             if (ImGui::IsItemHovered()) ImGui::SetTooltip("Determina quanto velocemente la scia scompare (0.99 = lunga, 0.90 = breve)");
 
+                            // Diffusion
+                            if (ImGui::TreeNode("Diffusion")) {
+                                static const char* diffusionModes[] = { "Direct (Box)", "FFT GPU", "FFT CPU" };
+                                ImGui::Combo("Mode", &params.diffusionMode, diffusionModes, IM_ARRAYSIZE(diffusionModes));
+                                ImGui::SliderInt("Radius", &params.diffusionRadius, 1, 64);
+                                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Diretto: costo ~ (2R+1)^2 per texel. FFT: costo ~ log(N), indipendente da R.");
+
+                                if (params.diffusionMode != 0) {
+                                    static const char* fftKernels[] = { "Gaussian", "Lenia Ring" };
+                                    ImGui::Combo("Kernel", &params.fftKernel, fftKernels, IM_ARRAYSIZE(fftKernels));
+                                    ImGui::Checkbox("Lenia Growth", &params.leniaGrowth);
+                                    if (params.leniaGrowth) {
+                                        ImGui::Indent();
+                                        ImGui::SliderFloat("Mu", &params.leniaMu, 0.0f, 0.5f, "%.3f");
+                                        ImGui::SliderFloat("Sigma", &params.leniaSigma, 0.001f, 0.1f, "%.4f");
+                                        ImGui::SliderFloat("Dt", &params.leniaDt, 0.0f, 1.0f, "%.2f");
+                                        ImGui::Unindent();
+                                    }
+                                }
+                                if (params.diffusionMode == 1 && !simulation.isFftGpuAvailable(params.diffusionRadius)) {
+                                    ImGui::TextColored(ImVec4(1.0f,0.6f,0.3f,1.0f), "FFT GPU: lato paddato > %d, uso il blur diretto", Fft::kMaxGpuLength);
+                                }
+                                if (params.diffusionMode == 2) {
+                                    ImGui::TextDisabled("FFT CPU: readback + upload ogni frame (riferimento)");
+                                }
+
+                                // Benchmark: costo per pass al variare del raggio, nelle tre modalita'
+                                static const int benchRadii[] = { 1, 2, 4, 8, 16, 32, 64 };
+                                static float benchMs[IM_ARRAYSIZE(benchRadii)][3] = {};
+                                static bool benchValid = false;
+                                if (ImGui::Button("Benchmark")) {
+                                    for (int r = 0; r < IM_ARRAYSIZE(benchRadii); ++r) {
+                                        for (int m = 0; m < 3; ++m) {
+                                            benchMs[r][m] = simulation.measureDiffusionCost(
+                                                static_cast<SimulationGPU::DiffusionMode>(m), benchRadii[r], 4);
+                                        }
+                                    }
+                                    benchValid = true;
+                                }
+                                if (benchValid && ImGui::BeginTable("DiffusionBench", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit)) {
+                                    ImGui::TableSetupColumn("R");
+                                    ImGui::TableSetupColumn("Direct");
+                                    ImGui::TableSetupColumn("FFT GPU");
+                                    ImGui::TableSetupColumn("FFT CPU");
+                                    ImGui::TableHeadersRow();
+                                    for (int r = 0; r < IM_ARRAYSIZE(benchRadii); ++r) {
+                                        ImGui::TableNextRow();
+                                        ImGui::TableSetColumnIndex(0);
+                                        ImGui::Text("%d", benchRadii[r]);
+                                        for (int m = 0; m < 3; ++m) {
+                                            ImGui::TableSetColumnIndex(m + 1);
+                                            if (benchMs[r][m] < 0.0f) ImGui::TextDisabled("n/a");
+                                            else ImGui::Text("%.3f ms", benchMs[r][m]);
+                                        }
+                                    }
+                                    ImGui::EndTable();
+                                }
+                                ImGui::TreePop();
+                            }
+
                             ImGui::Spacing();
 
                             // Colors
@@ -950,9 +1703,24 @@ int main(int argc, char **argv)
                 ImGui::PopStyleVar();
             }
 
+            // --- FORMAT BENCHMARK ---
+            if (formatBench.running) {
+                auto fmt = static_cast<SimulationGPU::TextureFormat>(formatBench.current);
+                if (simulation.getTextureFormat() == fmt && simulation.getFormatTiming(fmt).samples >= kFormatBenchSamples) {
+                    formatBench.current++;
+                    if (formatBench.current >= static_cast<int>(SimulationGPU::TextureFormat::Count)) {
+                        formatBench.running = false;
+                        params.textureFormat = formatBench.savedFormat;
+                    } else {
+                        params.textureFormat = formatBench.current;
+                        simulation.resetFormatTiming(static_cast<SimulationGPU::TextureFormat>(formatBench.current));
+                    }
+                }
+            }
+
             // --- UPDATE RESOLUTION / FORMAT ---
             Utils::SimulationManager::getSimulationSize((Utils::SimulationResolution)params.resolutionPreset, simWidth, simHeight);
-            simulation.resize(simWidth, simHeight, (SimulationGPU::TextureFormat)params.textureFormat);
+            simulation.resize(simWidth, simHeight, (SimulationGPU::TextureFormat)params.textureFormat, 1 << params.trailScale);
 
             // --- UPDATE RENDER PIPELIE ---
             renderPipeline.setColorMode(params.colorMode);
@@ -960,6 +1728,7 @@ int main(int argc, char **argv)
             renderPipeline.setColors(params.color1, params.color2);
             renderPipeline.setNeonParams(params.neonSpeed, params.neonRange);
             renderPipeline.setBackgroundColor(params.backgroundColor);
+            renderPipeline.setToneMapping(params.toneExposure, params.autoDimThreshold, params.autoDimStrength, params.autoDimGlobal);
             simulation.setColorSource(params.colorSource);
             simulation.setColorSpeedRange(params.colorSpeedMin, params.colorSpeedMax);
 
@@ -970,13 +1739,24 @@ int main(int argc, char **argv)
             simulation.setSensorDistance(params.sensorDistance);
             simulation.setSensorAngle(params.sensorAngle);
             simulation.setTurnAngle(params.turnAngle);
+            simulation.setSamplerSensingEnabled(params.samplerSensing);
+            simulation.setTrailPyramidEnabled(params.trailPyramid);
+            simulation.setPyramidBaseDistance(params.pyramidBaseDistance);
+            simulation.setSpeciesChannelsEnabled(params.speciesChannels);
+            simulation.setSpeciesCount(params.speciesCount);
+            for (int species = 0; species < kSpeciesCount; ++species) {
+                simulation.setSpeciesSettings(species, params.species[species]);
+                for (int column = 0; column <= kSpeciesCount; ++column) {
+                    simulation.setSpeciesInteraction(species, column, params.speciesMatrix[species][column]);
+                }
+            }
             simulation.setSpeedRange(params.speedMin, params.speedMax);
             simulation.setSpeed(params.speed);
             simulation.setTrailFade(params.trailFade);
-            simulation.setToneExposure(params.toneExposure);
-            simulation.setAutoDimThreshold(params.autoDimThreshold);
-            simulation.setAutoDimStrength(params.autoDimStrength);
-            simulation.setAutoDimGlobal(params.autoDimGlobal);
+            simulation.setDiffusionMode(static_cast<SimulationGPU::DiffusionMode>(params.diffusionMode));
+            simulation.setDiffusionRadius(params.diffusionRadius);
+            simulation.setFftKernel(static_cast<Fft::KernelType>(params.fftKernel));
+            simulation.setLeniaGrowth(params.leniaGrowth, params.leniaMu, params.leniaSigma, params.leniaDt);
             simulation.setInertia(params.inertia);
             simulation.setRestitution(params.restitution);
             simulation.setRandomWeight(0.05f); // Fixed for now
@@ -984,7 +1764,21 @@ int main(int argc, char **argv)
             // Collisions
             simulation.setCollisionsEnabled(params.collisionsEnabled);
             simulation.setCollisionRadius(params.collisionRadius);
+            simulation.setZoneForcesEnabled(params.zoneForces);
+            simulation.setZoneCellSize(params.zoneCellSize);
+            simulation.setZoneRadius(params.zoneRadius);
+            simulation.setZoneStrength(params.zoneStrength);
+            for (int s = 0; s < kSpeciesCount; ++s) {
+                simulation.setSpeciesZoneForce(s, params.zoneSpeciesForce[s][0], params.zoneSpeciesForce[s][1]);
+            }
             simulation.setBoundaryMode(params.boundaryMode);
+
+            // Reaction-diffusion
+            simulation.setReactionEnabled(params.reactionEnabled);
+            simulation.setReactionParams(params.reactionFeed, params.reactionKill, params.reactionDiffU, params.reactionDiffV);
+            simulation.setReactionSubsteps(params.reactionSubsteps);
+            simulation.setReactionCoupling(params.reactionDeposit, params.reactionSense);
+            renderPipeline.setReactionOverlay(params.reactionOverlay);
             simulation.setMouseFalloff(params.mouseFalloff);
             simulation.setMouseStrength(params.mouseStrength);
             simulation.setMouseGaussianSigma(params.mouseGaussianSigma);
@@ -1004,7 +1798,36 @@ int main(int argc, char **argv)
             simulation.setBoidsRadius(params.radius);
             
             // Particle pool
+            simulation.setParticleLayout(static_cast<ParticleLayout>(params.particleLayout));
+            params.particleLayout = static_cast<int>(simulation.getParticleLayout());
+            simulation.setShaderVariantsEnabled(params.shaderVariants);
+            simulation.setSeedDistribution(static_cast<SimulationGPU::SeedDistribution>(params.seedDistribution));
+            if (params.seedImage != loadedSeedImage) {
+                loadedSeedImage = params.seedImage;
+                std::vector<uint8_t> luminance;
+                seedImageWidth = seedImageHeight = 0;
+                if (!loadedSeedImage.empty()) {
+                    try {
+                        Utils::loadLuminanceImage(loadedSeedImage, luminance, seedImageWidth, seedImageHeight);
+                        std::cout << "[Seed] Image " << loadedSeedImage << " (" << seedImageWidth << "x" << seedImageHeight << ")" << std::endl;
+                    } catch (const std::exception& e) {
+                        // Immagine illeggibile: la semina Image torna alla trail invece di fermare il programma
+                        std::cout << "[Seed] " << e.what() << ", seeding from the trail" << std::endl;
+                        luminance.clear();
+                        seedImageWidth = seedImageHeight = 0;
+                    }
+                }
+                simulation.setSeedImage(luminance, seedImageWidth, seedImageHeight);
+            }
+            simulation.setEmitters(params.emitterList);
+            simulation.setEmittersEnabled(params.emitters);
             simulation.setActiveParticleCount(params.targetParticleCount);
+            simulation.setDeterministicEnabled(params.deterministic);
+            simulation.setDeterministicReferenceEnabled(params.deterministicReference);
+            simulation.setDeterministicHashInterval(params.deterministicHashInterval);
+
+            simulation.setActivityTrackingEnabled(params.steadyDetect);
+            simulation.setActivityInterval(params.steadyInterval);
 
             // --- INPUT & SIMULATION ---
             inputHandler.update();
@@ -1023,15 +1846,44 @@ int main(int argc, char **argv)
 
             int shaderMouseMode = params.mouseMode;
 
+            // Qualunque input o modifica dalla UI risveglia la simulazione
+            bool userActivity = isPressed || ImGui::IsAnyItemActive() || ImGui::IsAnyMouseDown()
+                             || io.MouseDelta.x != 0.0f || io.MouseDelta.y != 0.0f
+                             || io.MouseWheel != 0.0f || io.InputQueueCharacters.Size > 0;
+            for (int key = ImGuiKey_NamedKey_BEGIN; key < ImGuiKey_NamedKey_END && !userActivity; ++key) {
+                if (ImGui::IsKeyPressed(static_cast<ImGuiKey>(key), false)) userActivity = true;
+            }
+            if (!params.steadyDetect || userActivity) {
+                steady.calmSamples = 0;
+                steady.throttled = false;
+            }
+
             double currentTime = glfwGetTime();
             timeStepper.update(currentTime);
 
             while (timeStepper.hasSteps())
             {
                 double dt = timeStepper.getStepDt();
+                // Gli step saltati vengono consumati: la simulazione rallenta invece di recuperare dopo
+                if (steady.throttled) {
+                    if (params.steadyAction == 1) continue;
+                    if (++steady.skippedSteps % params.steadyRateDivisor != 0) continue;
+                }
                 simulation.update(static_cast<float>(dt), simMouseX, simMouseY, isPressed, shaderMouseMode);
             }
 
+            if (params.steadyDetect && !userActivity) {
+                const auto& activity = simulation.getActivityMetrics();
+                if (activity.sample != steady.lastSample) {
+                    steady.lastSample = activity.sample;
+                    bool calm = activity.trailChange < params.steadyThreshold && activity.energyChange < params.steadyThreshold;
+                    steady.calmSamples = calm ? steady.calmSamples + 1 : 0;
+                    // In rallentamento i campionamenti continuano: se il pattern riparte si torna a piena velocita'
+                    if (steady.calmSamples >= params.steadySamples) steady.throttled = true;
+                    else if (!calm) steady.throttled = false;
+                }
+            }
+
             // --- RENDER ---
             renderPipeline.render(simulation, windowManager.getWidth(), windowManager.getHeight());
             